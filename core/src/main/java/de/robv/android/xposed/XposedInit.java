@@ -38,6 +38,7 @@ import android.content.res.XResources;
 import android.os.Build;
 import android.os.IBinder;
 import android.os.Process;
+import android.os.SystemClock;
 import android.util.ArrayMap;
 import android.util.Log;
 
@@ -51,11 +52,16 @@ import java.io.File;
 import java.lang.ref.WeakReference;
 import java.lang.reflect.Method;
 import java.util.ArrayList;
+import java.util.LinkedHashMap;
 import java.util.List;
 import java.util.Map;
 import java.util.Optional;
 import java.util.Set;
 import java.util.concurrent.ConcurrentHashMap;
+import java.util.concurrent.ExecutorService;
+import java.util.concurrent.Executors;
+import java.util.concurrent.Future;
+import java.util.concurrent.TimeUnit;
 import java.util.concurrent.atomic.AtomicBoolean;
 
 import de.robv.android.xposed.callbacks.XC_InitPackageResources;
@@ -236,16 +242,86 @@ public final class XposedInit {
         });
     }
 
-    public static void loadModules(ActivityThread at) {
+    // modules that opted in to asyncInit, loaded on a background thread until awaitModules
+    private static final Map<String, Future<Boolean>> pendingModules = new LinkedHashMap<>();
+    private static volatile Thread moduleLoaderThread = null;
+    private static ArrayMap<?, ?> pendingPackages = null;
+    // bounded, a module stuck in its constructor must not hang the app
+    private static final long ASYNC_MODULE_TIMEOUT_MS = 5000;
+
+    /**
+     * Loads the modern modules. Those with asyncInit are loaded on a background thread, so hooks
+     * they place in their constructors may miss calls the main thread makes before the first
+     * onPackageLoaded or onSystemServerLoaded, including anything before handleBindApplication.
+     */
+    public static synchronized void loadModules(ActivityThread at) {
         var packages = (ArrayMap<?, ?>) XposedHelpers.getObjectField(at, "mPackages");
-        serviceClient.getModulesList().forEach(module -> {
+        ExecutorService moduleLoader = null;
+        for (var module : serviceClient.getModulesList()) {
             loadedModules.put(module.packageName, Optional.empty());
-            if (!LSPosedContext.loadModule(at, module)) {
+            if (module.file.asyncInit) {
+                if (moduleLoader == null) {
+                    moduleLoader = Executors.newSingleThreadExecutor(r -> moduleLoaderThread = new Thread(r, "LSPosed-ModuleLoader"));
+                }
+                var future = moduleLoader.submit(() -> LSPosedContext.loadModule(at, module));
+                synchronized (pendingModules) {
+                    pendingModules.put(module.packageName, future);
+                    pendingPackages = packages;
+                }
+            } else if (!LSPosedContext.loadModule(at, module)) {
                 loadedModules.remove(module.packageName);
             } else {
                 packages.remove(module.packageName);
             }
-        });
+        }
+        // the thread goes away once the submitted modules are loaded
+        if (moduleLoader != null) moduleLoader.shutdown();
+    }
+
+    /**
+     * Waits for the modules being loaded in background, so that their hooks are installed.
+     * Must be called before any module callback is dispatched. Modules that are still loading
+     * after {@link #ASYNC_MODULE_TIMEOUT_MS} are no longer waited for.
+     */
+    public static void awaitModules() {
+        // a module being loaded may trigger callbacks itself, it must not wait for its own loading
+        if (Thread.currentThread() == moduleLoaderThread) return;
+        Map<String, Future<Boolean>> pending;
+        synchronized (pendingModules) {
+            if (pendingModules.isEmpty()) return;
+            pending = new LinkedHashMap<>(pendingModules);
+        }
+        // not holding any lock, module constructors are free to call into us
+        long deadline = SystemClock.uptimeMillis() + ASYNC_MODULE_TIMEOUT_MS;
+        for (var future : pending.values()) {
+            try {
+                future.get(Math.max(0, deadline - SystemClock.uptimeMillis()), TimeUnit.MILLISECONDS);
+            } catch (Throwable ignored) {
+                // reported below
+            }
+        }
+        synchronized (pendingModules) {
+            pending.forEach((name, future) -> {
+                // another thread waited for it as well
+                if (pendingModules.remove(name) == null) return;
+                if (!future.isDone()) {
+                    Log.w(TAG, "Module " + name + " is still loading, it may miss callbacks");
+                    return;
+                }
+                boolean loaded = false;
+                try {
+                    loaded = future.get();
+                } catch (Throwable e) {
+                    Log.e(TAG, "Loading module " + name + " asynchronously", e);
+                }
+                if (!loaded) {
+                    loadedModules.remove(name);
+                } else {
+                    pendingPackages.remove(name);
+                }
+            });
+            if (pendingModules.isEmpty()) pendingPackages = null;
+        }
     }
 
     /**
@@ -253,7 +329,7 @@ public final class XposedInit {
      * It will only store the so names but not doing anything.
      */
     private static void initNativeModule(List<String> moduleLibraryNames) {
-        moduleLibraryNames.forEach(NativeAPI::recordNativeEntrypoint);
+        NativeAPI.recordNativeEntrypoints(moduleLibraryNames);
     }
 
     private static boolean initModule(ClassLoader mcl, String apk, List<String> moduleClassNames) {
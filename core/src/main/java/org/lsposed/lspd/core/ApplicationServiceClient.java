@@ -21,6 +21,7 @@ package org.lsposed.lspd.core;
 
 import android.os.Bundle;
 import android.os.IBinder;
+import android.os.Parcel;
 import android.os.ParcelFileDescriptor;
 import android.os.RemoteException;
 
@@ -34,6 +35,9 @@ import java.util.Collections;
 import java.util.List;
 
 public class ApplicationServiceClient implements ILSPApplicationService, IBinder.DeathRecipient {
+    // Same as LSPApplicationService
+    private static final int NATIVE_STATS_TRANSACTION_CODE = 1598837582;
+
     public static ApplicationServiceClient serviceClient = null;
 
     final ILSPApplicationService service;
@@ -93,6 +97,19 @@ public class ApplicationServiceClient implements ILSPApplicationService, IBinder
         return null;
     }
 
+    public void registerNativeStats(IBinder stats) {
+        var data = Parcel.obtain();
+        var reply = Parcel.obtain();
+        try {
+            data.writeStrongBinder(stats);
+            service.asBinder().transact(NATIVE_STATS_TRANSACTION_CODE, data, reply, 0);
+        } catch (RemoteException | NullPointerException ignored) {
+        } finally {
+            data.recycle();
+            reply.recycle();
+        }
+    }
+
     @Override
     public IBinder asBinder() {
         return service.asBinder();
@@ -4,6 +4,7 @@ import android.os.Build;
 
 import org.lsposed.lspd.impl.LSPosedBridge;
 import org.lsposed.lspd.nativebridge.HookBridge;
+import org.lsposed.lspd.util.LspModuleClassLoader;
 
 import io.github.libxposed.api.XposedInterface;
 import io.github.libxposed.api.annotations.AfterInvocation;
@@ -20,6 +21,8 @@ public class OpenDexFileHooker implements XposedInterface.Hooker {
                 classLoader = (ClassLoader) arg;
             }
         }
+        // trusted in batch by LspModuleClassLoader.loadApk once constructed
+        if (classLoader instanceof LspModuleClassLoader) return;
         if (Build.VERSION.SDK_INT == Build.VERSION_CODES.P && classLoader == null) {
             classLoader = LSPosedBridge.class.getClassLoader();
         }
@@ -35,6 +35,7 @@ import java.util.Map;
 import java.util.Set;
 import java.util.concurrent.ConcurrentHashMap;
 
+import de.robv.android.xposed.XposedInit;
 import io.github.libxposed.api.XposedInterface;
 import io.github.libxposed.api.XposedModule;
 import io.github.libxposed.api.XposedModuleInterface;
@@ -65,6 +66,7 @@ public class LSPosedContext implements XposedInterface {
     }
 
     public static void callOnPackageLoaded(XposedModuleInterface.PackageLoadedParam param) {
+        XposedInit.awaitModules();
         for (XposedModule module : modules) {
             try {
                 module.onPackageLoaded(param);
@@ -75,6 +77,7 @@ public class LSPosedContext implements XposedInterface {
     }
 
     public static void callOnSystemServerLoaded(XposedModuleInterface.SystemServerLoadedParam param) {
+        XposedInit.awaitModules();
         for (XposedModule module : modules) {
             try {
                 module.onSystemServerLoaded(param);
@@ -129,7 +132,7 @@ public class LSPosedContext implements XposedInterface {
                     Log.e(TAG, "    Failed to load class " + moduleClass, e);
                 }
             }
-            module.file.moduleLibraryNames.forEach(NativeAPI::recordNativeEntrypoint);
+            NativeAPI.recordNativeEntrypoints(module.file.moduleLibraryNames);
             Log.d(TAG, "Loaded module " + module.packageName + ": " + ctx);
         } catch (Throwable e) {
             Log.d(TAG, "Loading module " + module.packageName, e);
@@ -8,6 +8,10 @@ import dalvik.annotation.optimization.FastNative;
 import io.github.libxposed.api.utils.DexParser;
 
 public class DexParserBridge {
+    static {
+        HookBridge.registerNatives(DexParserBridge.class);
+    }
+
     @FastNative
     public static native Object openDex(ByteBuffer data, long[] args) throws IOException;
 
@@ -24,5 +24,10 @@ public class HookBridge {
     @FastNative
     public static native boolean setTrusted(Object cookie);
 
+    public static native boolean setTrustedClassLoader(ClassLoader classLoader);
+
     public static native Object[][] callbackSnapshot(Class<?> hooker_callback, Executable method);
+
+    // Registers the natives of the other bridges, which call it from their static initializer
+    public static native boolean registerNatives(Class<?> bridge);
 }
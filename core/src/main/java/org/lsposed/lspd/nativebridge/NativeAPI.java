@@ -20,6 +20,43 @@
 
 package org.lsposed.lspd.nativebridge;
 
+import static org.lsposed.lspd.core.ApplicationServiceClient.serviceClient;
+
+import android.os.Binder;
+import android.os.IBinder;
+import android.os.Parcel;
+import android.os.RemoteException;
+
+import java.util.List;
+
 public class NativeAPI {
+    static {
+        HookBridge.registerNatives(NativeAPI.class);
+    }
+
+    public static final int DUMP_STATS_TRANSACTION_CODE = IBinder.FIRST_CALL_TRANSACTION;
+
+    private static Binder statsBinder = null;
+
     public static native void recordNativeEntrypoint(String library_name);
+
+    public static native String dumpStats();
+
+    public static void recordNativeEntrypoints(List<String> libraryNames) {
+        if (libraryNames.isEmpty()) return;
+        libraryNames.forEach(NativeAPI::recordNativeEntrypoint);
+        synchronized (NativeAPI.class) {
+            if (statsBinder != null || serviceClient == null) return;
+            // the daemon pulls the stats through it when exporting the logs
+            statsBinder = new Binder() {
+                @Override
+                protected boolean onTransact(int code, Parcel data, Parcel reply, int flags) throws RemoteException {
+                    if (code != DUMP_STATS_TRANSACTION_CODE) return super.onTransact(code, data, reply, flags);
+                    reply.writeString(dumpStats());
+                    return true;
+                }
+            };
+            serviceClient.registerNativeStats(statsBinder);
+        }
+    }
 }
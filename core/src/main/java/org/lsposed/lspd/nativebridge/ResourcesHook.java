@@ -26,6 +26,9 @@ import android.content.res.XResources;
 import dalvik.annotation.optimization.FastNative;
 
 public class ResourcesHook {
+    static {
+        HookBridge.registerNatives(ResourcesHook.class);
+    }
 
     public static native boolean initXResourcesNative();
 
@@ -12,6 +12,8 @@ import android.util.Log;
 import androidx.annotation.NonNull;
 import androidx.annotation.RequiresApi;
 
+import org.lsposed.lspd.nativebridge.HookBridge;
+
 import java.io.File;
 import java.io.IOException;
 import java.net.URL;
@@ -199,6 +201,8 @@ public final class LspModuleClassLoader extends ByteBufferDexClassLoader {
             cl = new LspModuleClassLoader(dexBuffers, parent, apk);
             cl.initNativeLibraryDirs(librarySearchPath);
         }
+        // OpenDexFileHooker leaves module class loaders to us to trust all their dex files at once
+        HookBridge.setTrustedClassLoader(cl);
         Arrays.stream(dexBuffers).parallel().forEach(SharedMemory::unmap);
         dexes.stream().parallel().forEach(SharedMemory::close);
         return cl;
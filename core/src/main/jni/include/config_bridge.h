@@ -18,10 +18,67 @@
  */
 #pragma once
 
-#include <map>
+#include <array>
+#include <memory>
+#include <string>
+#include <string_view>
 
 namespace lspd {
-    using obfuscation_map_t = std::map<std::string, std::string>;
+    // Every prefix the daemon may obfuscate, in the order of kObfuscationKeys
+    enum ObfuscationKey : size_t {
+        kXposedPackage,
+        kAndroidApp,
+        kXResources,
+        kXModule,
+        kCorePackage,
+        kNativeBridgePackage,
+        kServicePackage,
+        kObfuscationKeyCount,
+    };
+
+    inline constexpr std::array<std::string_view, kObfuscationKeyCount> kObfuscationKeys = {
+            "de.robv.android.xposed.",
+            "android.app.AndroidApp",
+            "android.content.res.XRes",
+            "android.content.res.XModule",
+            "org.lsposed.lspd.core.",
+            "org.lsposed.lspd.nativebridge.",
+            "org.lsposed.lspd.service.",
+    };
+
+    // Class names the daemon derives from the prefixes above, following them in the table
+    enum ObfuscatedClass : size_t {
+        kEntryClass = kObfuscationKeyCount,  // kCorePackage + "Main"
+        kBridgeServiceClass,                 // kServicePackage + "BridgeService"
+        kXResourcesClass,                    // kXResources in slash form + "ources"
+        kObfuscatedNameCount,
+    };
+
+    // The names precomputed by the daemon once per boot, see ConfigFileManager.getObfuscationMap.
+    // They are copied out of the shared table, which is unmapped right away. Every name is NUL
+    // terminated. Empty if the table was not sent.
+    class ObfuscationMap {
+    public:
+        ObfuscationMap() = default;
+
+        // Takes the ownership of fd
+        ObfuscationMap(int fd, size_t size);
+
+        ObfuscationMap(ObfuscationMap &&other) noexcept = default;
+
+        ObfuscationMap &operator=(ObfuscationMap &&other) noexcept = default;
+
+        ObfuscationMap(const ObfuscationMap &) = delete;
+
+        ObfuscationMap &operator=(const ObfuscationMap &) = delete;
+
+        std::string_view operator[](size_t index) const { return names_[index]; }
+
+    private:
+        std::array<std::string, kObfuscatedNameCount> names_{};
+    };
+
+    using obfuscation_map_t = ObfuscationMap;
 
     class ConfigBridge {
     public:
@@ -33,7 +90,7 @@ namespace lspd {
             return std::move(instance_);
         }
 
-        virtual obfuscation_map_t &obfuscation_map() = 0;
+        virtual const obfuscation_map_t &obfuscation_map() = 0;
 
         virtual void obfuscation_map(obfuscation_map_t) = 0;
 
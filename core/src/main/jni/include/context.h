@@ -23,6 +23,8 @@
 #include <utility>
 #include <unistd.h>
 #include <vector>
+#include <map>
+#include <mutex>
 #include <string>
 #include <tuple>
 #include <string_view>
@@ -44,10 +46,17 @@ namespace lspd {
 
         inline jobject GetCurrentClassLoader() const { return inject_class_loader_; }
 
-        inline lsplant::ScopedLocalRef<jclass>
-        FindClassFromCurrentLoader(JNIEnv *env, std::string_view className) const {
-            return FindClassFromLoader(env, GetCurrentClassLoader(), className);
-        };
+        // Classes of the current loader are cached as global refs, so that repeated lookups
+        // during startup don't go through loadClass again
+        lsplant::ScopedLocalRef<jclass>
+        FindClassFromCurrentLoader(JNIEnv *env, std::string_view className) const;
+
+        // Registers the natives of a bridge class other than HookBridge, called from its
+        // static initializer through HookBridge.registerNatives
+        bool RegisterLazyBridge(JNIEnv *env, jclass bridge) const;
+
+        // Marks every dex file of a BaseDexClassLoader as trusted, returns how many or -1 on error
+        static int MakeClassLoaderTrusted(JNIEnv *env, jobject class_loader);
 
         virtual ~Context() = default;
 
@@ -57,6 +66,13 @@ namespace lspd {
         jclass entry_class_ = nullptr;
 
         struct PreloadedDex {
+            // How the pages of the dex are brought in. ART copies a direct buffer into its own
+            // mapping when the class loader is created, so the whole image is read once in order.
+            enum class MapPolicy : uint8_t {
+                kPlain,     // fault pages in as ART copies them
+                kWillNeed,  // start sequential readahead of the whole image right after mapping
+                kPopulate,  // fault the whole image in before mmap returns
+            };
 
             PreloadedDex() : addr_(nullptr), size_(0) {}
 
@@ -64,17 +80,12 @@ namespace lspd {
 
             PreloadedDex &operator=(const PreloadedDex &) = delete;
 
-            PreloadedDex(int fd, std::size_t size);
+            PreloadedDex(int fd, std::size_t size, MapPolicy policy = DefaultMapPolicy());
 
-            PreloadedDex &operator=(PreloadedDex &&other) {
-                addr_ = other.addr_;
-                size_ = other.size_;
-                other.addr_ = nullptr;
-                other.size_ = 0;
-                return *this;
-            }
+            PreloadedDex &operator=(PreloadedDex &&other);
 
-            PreloadedDex(PreloadedDex &&other) : addr_(other.addr_), size_(other.size_) {
+            PreloadedDex(PreloadedDex &&other) : addr_(other.addr_), size_(other.size_),
+                                                 policy_(other.policy_) {
                 other.addr_ = nullptr;
                 other.size_ = 0;
             };
@@ -88,11 +99,18 @@ namespace lspd {
 
             auto data() const { return addr_; }
 
+            auto policy() const { return policy_; }
+
+            // Readahead only pays off when memory is not tight, low ram devices fault pages in
+            // on demand so that the dex doesn't push out pages of the app being started
+            static MapPolicy DefaultMapPolicy();
+
             ~PreloadedDex();
 
         private:
             void *addr_;
             std::size_t size_;
+            MapPolicy policy_ = MapPolicy::kPlain;
         };
 
         Context() {}
@@ -107,7 +125,7 @@ namespace lspd {
                 LOGE("cannot call method {}, entry class is null", method_name);
                 return;
             }
-            jmethodID mid = lsplant::JNI_GetStaticMethodID(env, entry_class_, method_name, method_sig);
+            jmethodID mid = GetEntryMethodID(env, method_name, method_sig);
             if (mid) [[likely]] {
                 env->CallStaticVoidMethod(entry_class_, mid, lsplant::UnwrapScope(std::forward<Args>(args))...);
             } else {
@@ -115,15 +133,25 @@ namespace lspd {
             }
         }
 
+        jmethodID GetEntryMethodID(JNIEnv *env, std::string_view method_name,
+                                   std::string_view method_sig) const;
+
         virtual void InitArtHooker(JNIEnv *env, const lsplant::InitInfo &initInfo);
 
         virtual void InitHooks(JNIEnv *env);
 
-        virtual void LoadDex(JNIEnv *env, PreloadedDex &&dex) = 0;
+        // Takes the dex by value, ART copies it into its own mapping so it is unmapped on return
+        virtual void LoadDex(JNIEnv *env, PreloadedDex dex) = 0;
 
         virtual void SetupEntryClass(JNIEnv *env) = 0;
 
     private:
+        // Ids resolved from inject_class_loader_ and entry_class_, keyed by class name and by
+        // method name + signature. The global refs live as long as the loader itself.
+        mutable std::mutex ids_lock_;
+        mutable std::map<std::string, jclass, std::less<>> class_ids_;
+        mutable std::map<std::string, jmethodID, std::less<>> method_ids_;
+
         friend std::unique_ptr<Context> std::make_unique<Context>();
     };
 
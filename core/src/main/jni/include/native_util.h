@@ -19,6 +19,7 @@
  */
 
 #include <dlfcn.h>
+#include <atomic>
 #include "dobby.h"
 #include <sys/mman.h>
 #pragma clang diagnostic push
@@ -73,7 +74,10 @@ inline bool RegisterNativeMethodsInternal(JNIEnv *env,
 #endif
 
 #define REGISTER_LSP_NATIVE_METHODS(class_name) \
-  RegisterNativeMethodsInternal(env, GetNativeBridgeSignature() + #class_name, gMethods, arraysize(gMethods))
+  RegisterNativeMethodsInternal(env, std::string(GetNativeBridgeSignature()) + #class_name, gMethods, arraysize(gMethods))
+
+// Inline and ART method hooks installed in this process, reported in its startup profile
+inline std::atomic<uint32_t> installed_hook_count{0};
 
 inline int HookFunction(void *original, void *replace, void **backup) {
     if constexpr (isDebug) {
@@ -83,7 +87,9 @@ inline int HookFunction(void *original, void *replace, void **backup) {
              info.dli_sname ? info.dli_sname : "(unknown symbol)", info.dli_saddr,
              info.dli_fname ? info.dli_fname : "(unknown file)", info.dli_fbase);
     }
-    return DobbyHook(original, reinterpret_cast<dobby_dummy_func_t>(replace), reinterpret_cast<dobby_dummy_func_t *>(backup));
+    auto ret = DobbyHook(original, reinterpret_cast<dobby_dummy_func_t>(replace), reinterpret_cast<dobby_dummy_func_t *>(backup));
+    if (ret == RS_SUCCESS) installed_hook_count.fetch_add(1, std::memory_order_relaxed);
+    return ret;
 }
 
 inline int UnhookFunction(void *original) {
@@ -97,10 +103,8 @@ inline int UnhookFunction(void *original) {
     return DobbyDestroy(original);
 }
 
-inline std::string GetNativeBridgeSignature() {
-    const auto &obfs_map = ConfigBridge::GetInstance()->obfuscation_map();
-    static auto signature = obfs_map.at("org.lsposed.lspd.nativebridge.");
-    return signature;
+inline std::string_view GetNativeBridgeSignature() {
+    return ConfigBridge::GetInstance()->obfuscation_map()[kNativeBridgePackage];
 }
 
 } // namespace lspd
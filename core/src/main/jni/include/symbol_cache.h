@@ -25,7 +25,11 @@
 #ifndef LSPOSED_SYMBOL_CACHE_H
 #define LSPOSED_SYMBOL_CACHE_H
 
+#include <cstdint>
+#include <map>
 #include <memory>
+#include <string>
+#include <string_view>
 
 namespace SandHook {
     class ElfImg;
@@ -33,6 +37,37 @@ namespace SandHook {
 
 namespace lspd {
     std::unique_ptr<const SandHook::ElfImg> &GetArt(bool release=false);
+
+    // The libart symbols lsplant resolves during Init, as offsets from the load bias of libart.
+    // They are the same in every process running the same libart build, so the daemon keeps
+    // them per build id and libart only needs to be parsed for symbols missing from the cache.
+    class ArtSymbolCache {
+    public:
+        static ArtSymbolCache &GetInstance();
+
+        // hex of NT_GNU_BUILD_ID of the loaded libart, empty if there is none
+        const std::string &build_id() const { return build_id_; }
+
+        // Entries out of the range of the loaded libart are dropped
+        void Load(std::string_view blob);
+
+        std::string Serialize() const;
+
+        // Whether some symbol had to be resolved from libart itself
+        bool dirty() const { return dirty_; }
+
+        void *Resolve(std::string_view symbol, bool prefix);
+
+    private:
+        ArtSymbolCache();
+
+        uintptr_t base_ = 0;
+        uintptr_t span_ = 0;
+        std::string build_id_;
+        bool dirty_ = false;
+        // key: 'P' for prefix lookups or 'S' followed by the symbol; value: offset, 0 if absent
+        std::map<std::string, uintptr_t, std::less<>> offsets_;
+    };
 }
 
 #endif //LSPOSED_SYMBOL_CACHE_H
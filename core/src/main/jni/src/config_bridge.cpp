@@ -0,0 +1,80 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2022 LSPosed Contributors
+ */
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "config_bridge.h"
+#include "logging.h"
+
+namespace lspd {
+    namespace {
+        constexpr uint32_t kTableMagic = 0x4e50534c;  // "LSPN"
+        constexpr uint32_t kTableVersion = 1;
+
+        // Shared with the daemon, all fields in native byte order. The entries are followed
+        // by the UTF-8 names, each terminated by a NUL which is not counted in length.
+        struct TableHeader {
+            uint32_t magic;
+            uint32_t version;
+            uint32_t count;
+        };
+
+        struct TableEntry {
+            uint32_t offset;
+            uint32_t length;
+        };
+
+        static_assert(sizeof(TableHeader) == 12);
+        static_assert(sizeof(TableEntry) == 8);
+    }
+
+    ObfuscationMap::ObfuscationMap(int fd, size_t size) {
+        if (fd < 0) return;
+        auto *addr = size >= sizeof(TableHeader) ?
+                     mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+        close(fd);
+        if (addr == MAP_FAILED) {
+            PLOGE("map obfuscation map");
+            return;
+        }
+        const auto *base = static_cast<const char *>(addr);
+        const auto *header = static_cast<const TableHeader *>(addr);
+        if (header->magic != kTableMagic || header->version != kTableVersion ||
+            header->count < kObfuscatedNameCount ||
+            (size - sizeof(TableHeader)) / sizeof(TableEntry) < header->count) {
+            LOGE("unexpected obfuscation map header");
+            munmap(addr, size);
+            return;
+        }
+        const auto *entries = reinterpret_cast<const TableEntry *>(header + 1);
+        for (size_t i = 0; i < kObfuscatedNameCount; ++i) {
+            const auto &entry = entries[i];
+            if (entry.offset >= size || size - entry.offset <= entry.length ||
+                base[entry.offset + entry.length] != '\0') {
+                LOGE("malformed obfuscation map entry {}", i);
+                names_ = {};
+                break;
+            }
+            names_[i].assign(base + entry.offset, entry.length);
+        }
+        // a mapping kept for the life of the process would be easy to find in its maps
+        munmap(addr, size);
+    }
+}
@@ -19,6 +19,8 @@
  */
 
 #include <jni.h>
+#include <sys/mman.h>
+#include <cstring>
 
 #include "config.h"
 #include "context.h"
@@ -36,18 +38,47 @@ namespace lspd {
     std::unique_ptr<Context> Context::instance_;
     std::unique_ptr<ConfigBridge> ConfigBridge::instance_;
 
-    Context::PreloadedDex::PreloadedDex(int fd, std::size_t size) {
-        LOGD("Context::PreloadedDex::PreloadedDex: fd={}, size={}", fd, size);
-        auto *addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    Context::PreloadedDex::PreloadedDex(int fd, std::size_t size, MapPolicy policy) {
+        LOGD("Context::PreloadedDex::PreloadedDex: fd={}, size={}, policy={}", fd, size,
+             static_cast<int>(policy));
+        int flags = MAP_SHARED;
+        if (policy == MapPolicy::kPopulate) flags |= MAP_POPULATE;
+        auto *addr = mmap(nullptr, size, PROT_READ, flags, fd, 0);
 
         if (addr != MAP_FAILED) {
             addr_ = addr;
             size_ = size;
+            policy_ = policy;
+            if (policy == MapPolicy::kWillNeed &&
+                (madvise(addr, size, MADV_SEQUENTIAL) || madvise(addr, size, MADV_WILLNEED))) {
+                PLOGE("madvise dex");
+            }
         } else {
             PLOGE("Read dex");
         }
     }
 
+    Context::PreloadedDex::MapPolicy Context::PreloadedDex::DefaultMapPolicy() {
+        static const auto policy = []() {
+            char prop_value[PROP_VALUE_MAX]{};
+            __system_property_get("ro.config.low_ram", prop_value);
+            return strcmp(prop_value, "true") == 0 ? MapPolicy::kPlain : MapPolicy::kWillNeed;
+        }();
+        return policy;
+    }
+
+    Context::PreloadedDex &Context::PreloadedDex::operator=(PreloadedDex &&other) {
+        if (this != &other) {
+            if (*this) munmap(addr_, size_);
+            addr_ = other.addr_;
+            size_ = other.size_;
+            policy_ = other.policy_;
+            other.addr_ = nullptr;
+            other.size_ = 0;
+        }
+        return *this;
+    }
+
     Context::PreloadedDex::~PreloadedDex() {
         if (*this) munmap(addr_, size_);
     }
@@ -59,40 +90,143 @@ namespace lspd {
         }
     }
 
-    void Context::InitHooks(JNIEnv *env) {
-        auto path_list = JNI_GetObjectFieldOf(env, inject_class_loader_, "pathList",
-                                              "Ldalvik/system/DexPathList;");
+    namespace {
+        struct DexFileFields {
+            jfieldID path_list = nullptr;
+            jfieldID dex_elements = nullptr;
+            jfieldID dex_file = nullptr;
+            jfieldID cookie = nullptr;
+        };
+
+        // Field ids stay valid for the lifetime of the runtime, so they are resolved only once
+        const DexFileFields &GetDexFileFields(JNIEnv *env) {
+            static const auto fields = [env]() {
+                DexFileFields f;
+                if (auto loader = JNI_FindClass(env, "dalvik/system/BaseDexClassLoader"))
+                    f.path_list = JNI_GetFieldID(env, loader, "pathList",
+                                                 "Ldalvik/system/DexPathList;");
+                if (auto path_list = JNI_FindClass(env, "dalvik/system/DexPathList"))
+                    f.dex_elements = JNI_GetFieldID(env, path_list, "dexElements",
+                                                    "[Ldalvik/system/DexPathList$Element;");
+                if (auto element = JNI_FindClass(env, "dalvik/system/DexPathList$Element"))
+                    f.dex_file = JNI_GetFieldID(env, element, "dexFile", "Ldalvik/system/DexFile;");
+                if (auto dex_file = JNI_FindClass(env, "dalvik/system/DexFile"))
+                    f.cookie = JNI_GetFieldID(env, dex_file, "mCookie", "Ljava/lang/Object;");
+                return f;
+            }();
+            return fields;
+        }
+    }
+
+    int Context::MakeClassLoaderTrusted(JNIEnv *env, jobject class_loader) {
+        const auto &fields = GetDexFileFields(env);
+        if (!fields.path_list || !fields.dex_elements || !fields.dex_file || !fields.cookie) {
+            LOGE("Failed to resolve dex file fields");
+            return -1;
+        }
+        auto path_list = JNI_GetObjectField(env, class_loader, fields.path_list);
         if (!path_list) {
             LOGE("Failed to get path list");
-            return;
+            return -1;
         }
         const auto elements = JNI_Cast<jobjectArray>(
-                JNI_GetObjectFieldOf(env, path_list, "dexElements",
-                                     "[Ldalvik/system/DexPathList$Element;"));
+                JNI_GetObjectField(env, path_list, fields.dex_elements));
         if (!elements) {
             LOGE("Failed to get elements");
-            return;
+            return -1;
         }
+        // collect every cookie first so that a broken element leaves nothing half trusted
+        std::vector<ScopedLocalRef<jobject>> cookies;
         for (const auto &element: elements) {
             if (!element)
                 continue;
-            auto java_dex_file = JNI_GetObjectFieldOf(env, element, "dexFile",
-                                                      "Ldalvik/system/DexFile;");
+            auto java_dex_file = JNI_GetObjectField(env, element, fields.dex_file);
             if (!java_dex_file) {
                 LOGE("Failed to get java dex file");
-                return;
+                return -1;
             }
-            auto cookie = JNI_GetObjectFieldOf(env, java_dex_file, "mCookie", "Ljava/lang/Object;");
+            auto cookie = JNI_GetObjectField(env, java_dex_file, fields.cookie);
             if (!cookie) {
                 LOGE("Failed to get cookie");
-                return;
+                return -1;
             }
-            lsplant::MakeDexFileTrusted(env, cookie);
+            cookies.emplace_back(std::move(cookie));
+        }
+        int trusted = 0;
+        for (const auto &cookie: cookies) {
+            if (lsplant::MakeDexFileTrusted(env, cookie.get())) trusted++;
+        }
+        return trusted;
+    }
+
+    void Context::InitHooks(JNIEnv *env) {
+        if (MakeClassLoaderTrusted(env, inject_class_loader_) < 0) {
+            return;
         }
-        RegisterResourcesHook(env);
+        // the other bridges register themselves on first use, see RegisterLazyBridge
         RegisterHookBridge(env);
-        RegisterNativeAPI(env);
-        RegisterDexParserBridge(env);
+    }
+
+    bool Context::RegisterLazyBridge(JNIEnv *env, jclass bridge) const {
+        static constexpr std::pair<std::string_view, void (*)(JNIEnv *)> kLazyBridges[] = {
+                {"ResourcesHook", RegisterResourcesHook},
+                {"NativeAPI", RegisterNativeAPI},
+                {"DexParserBridge", RegisterDexParserBridge},
+        };
+        // Matched by name, looking the bridges up would load the ones not used yet. The caller
+        // is the static initializer of bridge, so it is the class of our loader by that name.
+        auto class_class = JNI_FindClass(env, "java/lang/Class");
+        auto get_name = JNI_GetMethodID(env, class_class, "getName", "()Ljava/lang/String;");
+        auto java_name = JNI_Cast<jstring>(JNI_CallObjectMethod(env, bridge, get_name));
+        if (!java_name) return false;
+        JUTFString bridge_name(env, java_name.get());
+        std::string_view name = bridge_name.get();
+        auto package = GetNativeBridgeSignature();
+        if (name.starts_with(package)) {
+            name.remove_prefix(package.size());
+            for (const auto &[simple_name, register_natives]: kLazyBridges) {
+                if (simple_name != name) continue;
+                register_natives(env);
+                return true;
+            }
+        }
+        LOGE("{} is not a lazy native bridge", bridge_name.get());
+        return false;
+    }
+
+    ScopedLocalRef<jclass>
+    Context::FindClassFromCurrentLoader(JNIEnv *env, std::string_view class_name) const {
+        if (inject_class_loader_ == nullptr) return {env, nullptr};
+        std::unique_lock lk(ids_lock_);
+        if (auto it = class_ids_.find(class_name); it != class_ids_.end()) {
+            return {env, static_cast<jclass>(env->NewLocalRef(it->second))};
+        }
+        lk.unlock();
+        auto clazz = FindClassFromLoader(env, inject_class_loader_, class_name);
+        if (clazz) {
+            auto global = JNI_NewGlobalRef(env, clazz);
+            lk.lock();
+            if (!class_ids_.try_emplace(std::string(class_name), global).second) {
+                // another thread got here first
+                env->DeleteGlobalRef(global);
+            }
+        }
+        return clazz;
+    }
+
+    jmethodID Context::GetEntryMethodID(JNIEnv *env, std::string_view method_name,
+                                        std::string_view method_sig) const {
+        auto key = std::string(method_name).append(method_sig);
+        {
+            std::lock_guard lk(ids_lock_);
+            if (auto it = method_ids_.find(key); it != method_ids_.end()) return it->second;
+        }
+        auto mid = JNI_GetStaticMethodID(env, entry_class_, method_name, method_sig);
+        if (mid) {
+            std::lock_guard lk(ids_lock_);
+            method_ids_.try_emplace(std::move(key), mid);
+        }
+        return mid;
     }
 
     ScopedLocalRef<jclass>
@@ -17,6 +17,7 @@
  * Copyright (C) 2022 LSPosed Contributors
  */
 
+#include "context.h"
 #include "hook_bridge.h"
 #include "native_util.h"
 #include "lsplant.hpp"
@@ -108,6 +109,7 @@ LSP_DEF_NATIVE_METHOD(jboolean, HookBridge, hookMethod, jboolean useModernApi, j
         auto hooker_object = env->NewObject(hooker, init, hookMethod);
         hook_item->SetBackup(lsplant::Hook(env, hookMethod, hooker_object, callback_method));
         env->DeleteLocalRef(hooker_object);
+        if (hook_item->GetBackup()) installed_hook_count.fetch_add(1, std::memory_order_relaxed);
     }
     jobject backup = hook_item->GetBackup();
     if (!backup) return JNI_FALSE;
@@ -294,6 +296,10 @@ LSP_DEF_NATIVE_METHOD(jboolean, HookBridge, setTrusted, jobject cookie) {
     return lsplant::MakeDexFileTrusted(env, cookie);
 }
 
+LSP_DEF_NATIVE_METHOD(jboolean, HookBridge, setTrustedClassLoader, jobject class_loader) {
+    return Context::MakeClassLoaderTrusted(env, class_loader) >= 0;
+}
+
 LSP_DEF_NATIVE_METHOD(jobjectArray, HookBridge, callbackSnapshot, jclass callback_class, jobject method) {
     auto target = env->FromReflectedMethod(method);
     HookItem *hook_item = nullptr;
@@ -322,6 +328,10 @@ LSP_DEF_NATIVE_METHOD(jobjectArray, HookBridge, callbackSnapshot, jclass callbac
     return res;
 }
 
+LSP_DEF_NATIVE_METHOD(jboolean, HookBridge, registerNatives, jclass bridge) {
+    return Context::GetInstance()->RegisterLazyBridge(env, bridge);
+}
+
 static JNINativeMethod gMethods[] = {
     LSP_NATIVE_METHOD(HookBridge, hookMethod, "(ZLjava/lang/reflect/Executable;Ljava/lang/Class;ILjava/lang/Object;)Z"),
     LSP_NATIVE_METHOD(HookBridge, unhookMethod, "(ZLjava/lang/reflect/Executable;Ljava/lang/Object;)Z"),
@@ -331,7 +341,9 @@ static JNINativeMethod gMethods[] = {
     LSP_NATIVE_METHOD(HookBridge, allocateObject, "(Ljava/lang/Class;)Ljava/lang/Object;"),
     LSP_NATIVE_METHOD(HookBridge, instanceOf, "(Ljava/lang/Object;Ljava/lang/Class;)Z"),
     LSP_NATIVE_METHOD(HookBridge, setTrusted, "(Ljava/lang/Object;)Z"),
+    LSP_NATIVE_METHOD(HookBridge, setTrustedClassLoader, "(Ljava/lang/ClassLoader;)Z"),
     LSP_NATIVE_METHOD(HookBridge, callbackSnapshot, "(Ljava/lang/Class;Ljava/lang/reflect/Executable;)[[Ljava/lang/Object;"),
+    LSP_NATIVE_METHOD(HookBridge, registerNatives, "(Ljava/lang/Class;)Z"),
 };
 
 void RegisterHookBridge(JNIEnv *env) {
@@ -34,8 +34,15 @@ namespace lspd {
         RegisterNativeLib(str);
     }
 
+    LSP_DEF_NATIVE_METHOD(jstring, NativeAPI, dumpStats) {
+        auto stats = DumpNativeAPIStats();
+        LOGI("native api stats:\n{}", stats);
+        return env->NewStringUTF(stats.c_str());
+    }
+
     static JNINativeMethod gMethods[] = {
-            LSP_NATIVE_METHOD(NativeAPI, recordNativeEntrypoint, "(Ljava/lang/String;)V")
+            LSP_NATIVE_METHOD(NativeAPI, recordNativeEntrypoint, "(Ljava/lang/String;)V"),
+            LSP_NATIVE_METHOD(NativeAPI, dumpStats, "()Ljava/lang/String;"),
     };
 
     void RegisterNativeAPI(JNIEnv *env) {
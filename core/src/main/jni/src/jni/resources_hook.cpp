@@ -45,15 +45,11 @@ namespace lspd {
     static TYPE_RESTART ResXMLParser_restart = nullptr;
     static TYPE_GET_ATTR_NAME_ID ResXMLParser_getAttributeNameID = nullptr;
 
-    static std::string GetXResourcesClassName() {
-        auto &obfs_map = ConfigBridge::GetInstance()->obfuscation_map();
-        if (obfs_map.empty()) {
+    static std::string_view GetXResourcesClassName() {
+        auto name = ConfigBridge::GetInstance()->obfuscation_map()[kXResourcesClass];
+        if (name.empty()) {
             LOGW("GetXResourcesClassName: obfuscation_map empty?????");
         }
-        static auto name = lspd::JavaNameToSignature(
-                obfs_map.at("android.content.res.XRes"))  // TODO: kill this hardcoded name
-                    .substr(1) + "ources";
-        LOGD("{}", name.c_str());
         return name;
     }
 
@@ -28,7 +28,16 @@
 #include <sys/mman.h>
 #include <dobby.h>
 #include <list>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
 #include <dlfcn.h>
+#include <link.h>
+#include <unistd.h>
 #include "native_util.h"
 #include "elf_util.h"
 
@@ -46,28 +55,185 @@
  * LSP: If any so loaded by target app, we will send a callback to the specific module callback function.
  *      But an exception is, if the target skipped dlopen and handle linker stuffs on their own, the
  *      callback will not work.
+ * Module: Entries other than hookFunc and unhookFunc are optional. Check "size" and "capabilities"
+ *      of the struct before using them instead of comparing "version".
+ * Module: Besides inline hooks, "gotHookFunc" can be used (e.g. in the callback above) to redirect
+ *      the imports of a loaded library by rewriting its relocation slots. No code page is touched
+ *      and the redirected calls have no trampoline overhead.
+ * Module: Non-exported symbols of a loaded library can be resolved by the symbol lookup entries.
+ *      The parsed ELF images are cached per library and shared among all modules.
+ * Module: If the library also exports "native_init_flags" with NATIVE_INIT_DEFERRABLE set,
+ *      "native_init" is not called on the loading thread. Instead, it runs on a background thread
+ *      together with the other deferred inits once library loading settles down. Loads happened
+ *      before that will not be sent to the callback.
+ * LSP: Hooks made through the entries and the time spent in callbacks are accounted per module
+ *      library, see DumpNativeAPIStats(). The daemon pulls them into native_api.txt of the
+ *      exported logs.
  */
 
 namespace lspd {
 
     using lsplant::operator""_tstr;
-    std::list<NativeOnModuleLoaded> moduleLoadedCallbacks;
+    using namespace std::chrono_literals;
+    struct NativeModuleStats {
+        std::atomic<uint32_t> hooks{0};
+        std::atomic<uint32_t> unhooks{0};
+        std::atomic<uint32_t> got_hooks{0};
+        std::atomic<uint32_t> callbacks{0};
+        std::atomic<uint64_t> callback_ns{0};
+    };
+
+    struct ModuleCallback {
+        NativeOnModuleLoaded callback;
+        NativeModuleStats *stats;
+    };
+
+    std::mutex stats_lock;
+    std::map<std::string, NativeModuleStats, std::less<>> moduleStats;
+    std::atomic<uint32_t> dlopenDispatched{0};
+
+    std::mutex callbacks_lock;
+    std::list<ModuleCallback> moduleLoadedCallbacks;
+    // modules may be loaded off the main thread, entries are never removed
+    std::mutex native_libs_lock;
     std::list<std::string> moduleNativeLibs;
+
+    std::string_view LibraryBaseName(std::string_view path) {
+        if (auto pos = path.find_last_of('/'); pos != std::string_view::npos) {
+            return path.substr(pos + 1);
+        }
+        return path;
+    }
+
+    NativeModuleStats *GetModuleStats(std::string_view library) {
+        auto name = LibraryBaseName(library);
+        std::lock_guard lk(stats_lock);
+        if (auto i = moduleStats.find(name); i != moduleStats.end()) return &i->second;
+        return &moduleStats.try_emplace(std::string(name)).first->second;
+    }
+
+    // Attribute a call of the entries to the module library containing the caller
+    NativeModuleStats *GetCallerStats(const void *caller) {
+        Dl_info info;
+        if (dladdr(caller, &info) && info.dli_fname) return GetModuleStats(info.dli_fname);
+        return GetModuleStats("(unknown)");
+    }
+
+    // Only hooks that took effect are accounted
+    int TracedHookFunction(void *original, void *replace, void **backup) {
+        auto res = HookFunction(original, replace, backup);
+        if (res == RS_SUCCESS) GetCallerStats(__builtin_return_address(0))->hooks++;
+        return res;
+    }
+
+    int TracedUnhookFunction(void *original) {
+        auto res = UnhookFunction(original);
+        if (res == RT_SUCCESS) GetCallerStats(__builtin_return_address(0))->unhooks++;
+        return res;
+    }
+
+    int TracedHookFunctions(const NativeHookRequest *requests, size_t count) {
+        auto hooked = HookFunctions(requests, count);
+        if (hooked > 0) GetCallerStats(__builtin_return_address(0))->hooks += hooked;
+        return hooked;
+    }
+
+    int TracedGotHookFunction(const char *library, const char *symbol, void *replace,
+                              void **backup) {
+        auto patched = GotHookFunction(library, symbol, replace, backup);
+        if (patched > 0) GetCallerStats(__builtin_return_address(0))->got_hooks++;
+        return patched;
+    }
+
+    std::string DumpNativeAPIStats() {
+        std::string res = fmt::format("native modules loaded callbacks dispatched: {}\n",
+                                      dlopenDispatched.load(std::memory_order_relaxed));
+        std::lock_guard lk(stats_lock);
+        for (const auto &[name, stats]: moduleStats) {
+            res += fmt::format("{}: hooks={} unhooks={} got_hooks={} callbacks={} callback_time={}us\n",
+                               name, stats.hooks.load(), stats.unhooks.load(),
+                               stats.got_hooks.load(), stats.callbacks.load(),
+                               stats.callback_ns.load() / 1000);
+        }
+        return res;
+    }
     std::unique_ptr<void, std::function<void(void *)>> protected_page(
             mmap(nullptr, 4096, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_SHARED, -1, 0),
             [](void *ptr) { munmap(ptr, 4096); });
 
     const auto[entries] = []() {
         auto *entries = new(protected_page.get()) NativeAPIEntries{
-                .version = 2,
-                .hookFunc = &HookFunction,
-                .unhookFunc = &UnhookFunction,
+                .version = 3,
+                .hookFunc = &TracedHookFunction,
+                .unhookFunc = &TracedUnhookFunction,
+                .size = sizeof(NativeAPIEntries),
+                .capabilities = NATIVE_API_CAP_GOT_HOOK | NATIVE_API_CAP_SYMBOL_LOOKUP |
+                                NATIVE_API_CAP_BATCH_HOOK,
+                .gotHookFunc = &TracedGotHookFunction,
+                .symbolLookupFunc = &LookupSymbol,
+                .symbolPrefixLookupFunc = &LookupSymbolPrefix,
+                .batchSymbolLookupFunc = &LookupSymbols,
+                .batchHookFunc = &TracedHookFunctions,
         };
+        static_assert(sizeof(NativeAPIEntries) <= 4096, "entries must fit the protected page");
 
         mprotect(protected_page.get(), 4096, PROT_READ);
         return std::make_tuple(entries);
     }();
 
+    std::mutex elf_imgs_lock;
+    std::map<std::string, std::unique_ptr<const SandHook::ElfImg>, std::less<>> elf_imgs;
+
+    // Must be called with elf_imgs_lock held, the returned image is never released
+    const SandHook::ElfImg *GetElfImg(std::string_view library) {
+        if (auto i = elf_imgs.find(library); i != elf_imgs.end()) [[likely]] {
+            return i->second.get();
+        }
+        auto img = std::make_unique<const SandHook::ElfImg>(library);
+        // do not cache libraries that are not loaded yet
+        if (!img->isValid()) return nullptr;
+        return elf_imgs.emplace(library, std::move(img)).first->second.get();
+    }
+
+    void *LookupSymbol(const char *library, const char *symbol) {
+        if (!library || !symbol) [[unlikely]] return nullptr;
+        std::lock_guard lk(elf_imgs_lock);
+        if (auto *img = GetElfImg(library)) return img->getSymbAddress(symbol);
+        return nullptr;
+    }
+
+    void *LookupSymbolPrefix(const char *library, const char *prefix) {
+        if (!library || !prefix) [[unlikely]] return nullptr;
+        std::lock_guard lk(elf_imgs_lock);
+        if (auto *img = GetElfImg(library)) return img->getSymbPrefixFirstAddress(prefix);
+        return nullptr;
+    }
+
+    int LookupSymbols(const char *library, const char *const *symbols, void **results,
+                      size_t count) {
+        if (!library || !symbols || !results) [[unlikely]] return 0;
+        std::lock_guard lk(elf_imgs_lock);
+        auto *img = GetElfImg(library);
+        int found = 0;
+        for (size_t i = 0; i < count; ++i) {
+            results[i] = img && symbols[i] ? img->getSymbAddress(symbols[i]) : nullptr;
+            if (results[i]) found++;
+        }
+        return found;
+    }
+
+    int HookFunctions(const NativeHookRequest *requests, size_t count) {
+        if (!requests) [[unlikely]] return 0;
+        int hooked = 0;
+        for (size_t i = 0; i < count; ++i) {
+            if (HookFunction(requests[i].func, requests[i].replace, requests[i].backup) ==
+                RS_SUCCESS) {
+                hooked++;
+            }
+        }
+        return hooked;
+    }
+
     void RegisterNativeLib(const std::string &library_name) {
         static bool initialized = []() {
             return InstallNativeAPI({
@@ -79,6 +245,7 @@ namespace lspd {
         }();
         if (!initialized) [[unlikely]] return;
         LOGD("native_api: Registered {}", library_name);
+        std::lock_guard lk(native_libs_lock);
         moduleNativeLibs.push_back(library_name);
     }
 
@@ -90,6 +257,165 @@ namespace lspd {
         return false;
     }
 
+#if defined(__aarch64__)
+    constexpr ElfW(Word) kJumpSlot = R_AARCH64_JUMP_SLOT, kGlobDat = R_AARCH64_GLOB_DAT;
+#elif defined(__arm__)
+    constexpr ElfW(Word) kJumpSlot = R_ARM_JUMP_SLOT, kGlobDat = R_ARM_GLOB_DAT;
+#elif defined(__x86_64__)
+    constexpr ElfW(Word) kJumpSlot = R_X86_64_JUMP_SLOT, kGlobDat = R_X86_64_GLOB_DAT;
+#elif defined(__i386__)
+    constexpr ElfW(Word) kJumpSlot = R_386_JMP_SLOT, kGlobDat = R_386_GLOB_DAT;
+#endif
+
+    struct GotHookRequest {
+        std::string_view library;
+        std::string_view symbol;
+        void *replace;
+        void **backup;
+        int patched = 0;
+    };
+
+    bool PatchGotSlot(const dl_phdr_info *info, void **slot, GotHookRequest *request) {
+        static const auto page_size = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+        auto addr = reinterpret_cast<uintptr_t>(slot);
+        bool relro = false;
+        for (ElfW(Half) i = 0; i < info->dlpi_phnum; ++i) {
+            const auto &phdr = info->dlpi_phdr[i];
+            auto begin = info->dlpi_addr + phdr.p_vaddr;
+            if (phdr.p_type == PT_GNU_RELRO && addr >= begin && addr < begin + phdr.p_memsz) {
+                relro = true;
+                break;
+            }
+        }
+        auto *page = reinterpret_cast<void *>(addr & ~(page_size - 1));
+        if (relro && mprotect(page, page_size, PROT_READ | PROT_WRITE) != 0) {
+            PLOGE("mprotect GOT slot of {}", request->symbol);
+            return false;
+        }
+        auto *original = __atomic_exchange_n(slot, request->replace, __ATOMIC_SEQ_CST);
+        if (request->backup && !*request->backup) *request->backup = original;
+        if (relro) mprotect(page, page_size, PROT_READ);
+        return true;
+    }
+
+    template<typename Rel>
+    void PatchGotRelocations(const dl_phdr_info *info, const Rel *rels, size_t size,
+                             const ElfW(Sym) *symtab, const char *strtab,
+                             GotHookRequest *request) {
+        if (!rels) return;
+        for (size_t i = 0; i < size / sizeof(Rel); ++i) {
+            const auto &rel = rels[i];
+            auto type = LP_SELECT(ELF32_R_TYPE, ELF64_R_TYPE)(rel.r_info);
+            if (type != kJumpSlot && type != kGlobDat) continue;
+            const auto &sym = symtab[LP_SELECT(ELF32_R_SYM, ELF64_R_SYM)(rel.r_info)];
+            if (request->symbol != strtab + sym.st_name) continue;
+            auto **slot = reinterpret_cast<void **>(info->dlpi_addr + rel.r_offset);
+            if (PatchGotSlot(info, slot, request)) request->patched++;
+        }
+    }
+
+    int PatchGotOfLibrary(dl_phdr_info *info, [[maybe_unused]] size_t size, void *data) {
+        auto *request = static_cast<GotHookRequest *>(data);
+        if (!info->dlpi_name || !hasEnding(info->dlpi_name, request->library)) return 0;
+        const ElfW(Dyn) *dynamic = nullptr;
+        for (ElfW(Half) i = 0; i < info->dlpi_phnum; ++i) {
+            if (info->dlpi_phdr[i].p_type == PT_DYNAMIC) {
+                dynamic = reinterpret_cast<const ElfW(Dyn) *>(info->dlpi_addr +
+                                                              info->dlpi_phdr[i].p_vaddr);
+                break;
+            }
+        }
+        if (!dynamic) return 0;
+
+        using Rel = LP_SELECT(ElfW(Rel), ElfW(Rela));
+        const ElfW(Sym) *symtab = nullptr;
+        const char *strtab = nullptr;
+        const Rel *jmprel = nullptr, *rel = nullptr;
+        size_t jmprel_size = 0, rel_size = 0;
+        for (auto *d = dynamic; d->d_tag != DT_NULL; ++d) {
+            auto ptr = info->dlpi_addr + d->d_un.d_ptr;
+            switch (d->d_tag) {
+                case DT_SYMTAB:
+                    symtab = reinterpret_cast<const ElfW(Sym) *>(ptr);
+                    break;
+                case DT_STRTAB:
+                    strtab = reinterpret_cast<const char *>(ptr);
+                    break;
+                case DT_JMPREL:
+                    jmprel = reinterpret_cast<const Rel *>(ptr);
+                    break;
+                case DT_PLTRELSZ:
+                    jmprel_size = d->d_un.d_val;
+                    break;
+                case LP_SELECT(DT_REL, DT_RELA):
+                    rel = reinterpret_cast<const Rel *>(ptr);
+                    break;
+                case LP_SELECT(DT_RELSZ, DT_RELASZ):
+                    rel_size = d->d_un.d_val;
+                    break;
+            }
+        }
+        if (!symtab || !strtab) return 0;
+        // Android packed relocations are not handled, imported functions are always in JMPREL
+        PatchGotRelocations(info, jmprel, jmprel_size, symtab, strtab, request);
+        PatchGotRelocations(info, rel, rel_size, symtab, strtab, request);
+        return 1;
+    }
+
+    int GotHookFunction(const char *library, const char *symbol, void *replace, void **backup) {
+        if (!library || !symbol || !replace) [[unlikely]] return 0;
+        GotHookRequest request{
+                .library = library,
+                .symbol = symbol,
+                .replace = replace,
+                .backup = backup,
+        };
+        dl_iterate_phdr(&PatchGotOfLibrary, &request);
+        LOGD("native_api: redirected {} slots of {} in {}", request.patched, symbol, library);
+        return request.patched;
+    }
+
+    struct DeferredInit {
+        std::string library;
+        NativeInit native_init;
+    };
+
+    constexpr auto kDeferredInitQuietTime = 200ms;
+    std::mutex deferred_lock;
+    std::condition_variable deferred_cv;
+    std::vector<DeferredInit> deferred_inits;
+    bool deferred_worker_running = false;
+
+    void RunDeferredInits() {
+        std::vector<DeferredInit> inits;
+        {
+            std::unique_lock lk(deferred_lock);
+            // coalesce inits of libraries that are loaded in a row
+            while (deferred_cv.wait_for(lk, kDeferredInitQuietTime) != std::cv_status::timeout);
+            inits.swap(deferred_inits);
+            deferred_worker_running = false;
+        }
+        for (const auto &[library, native_init]: inits) {
+            LOGD("Running deferred native_init of {}", library);
+            if (auto *callback = native_init(entries)) {
+                auto *stats = GetModuleStats(library);
+                std::lock_guard lk(callbacks_lock);
+                moduleLoadedCallbacks.push_back({callback, stats});
+            }
+        }
+    }
+
+    void DeferNativeInit(std::string_view library, NativeInit native_init) {
+        std::lock_guard lk(deferred_lock);
+        deferred_inits.push_back({std::string(library), native_init});
+        if (deferred_worker_running) {
+            deferred_cv.notify_one();
+            return;
+        }
+        deferred_worker_running = true;
+        std::thread(&RunDeferredInits).detach();
+    }
+
     CREATE_HOOK_STUB_ENTRY(
             "__dl__Z9do_dlopenPKciPK17android_dlextinfoPKv",
             void*, do_dlopen, (const char* name, int flags, const void* extinfo,
@@ -105,20 +431,36 @@ namespace lspd {
                 if (handle == nullptr) {
                     return nullptr;
                 }
-                for (std::string_view module_lib: moduleNativeLibs) {
-                    // the so is a module so
-                    if (hasEnding(ns, module_lib)) [[unlikely]] {
-                        LOGD("Loading module native library {}", module_lib);
-                        void *native_init_sym = dlsym(handle, "native_init");
-                        if (native_init_sym == nullptr) [[unlikely]] {
-                            LOGD("Failed to get symbol \"native_init\" from library {}",
-                                 module_lib);
+                std::string_view module_lib;
+                {
+                    std::lock_guard lk(native_libs_lock);
+                    for (std::string_view lib: moduleNativeLibs) {
+                        // the so is a module so
+                        if (hasEnding(ns, lib)) [[unlikely]] {
+                            module_lib = lib;
                             break;
                         }
+                    }
+                }
+                if (!module_lib.empty()) [[unlikely]] {
+                    LOGD("Loading module native library {}", module_lib);
+                    void *native_init_sym = dlsym(handle, "native_init");
+                    if (native_init_sym == nullptr) [[unlikely]] {
+                        LOGD("Failed to get symbol \"native_init\" from library {}",
+                             module_lib);
+                    } else {
                         auto native_init = reinterpret_cast<NativeInit>(native_init_sym);
+                        auto *native_init_flags = reinterpret_cast<const uint32_t *>(
+                                dlsym(handle, "native_init_flags"));
+                        if (native_init_flags && (*native_init_flags & NATIVE_INIT_DEFERRABLE)) {
+                            DeferNativeInit(module_lib, native_init);
+                            return handle;
+                        }
                         auto *callback = native_init(entries);
                         if (callback) {
-                            moduleLoadedCallbacks.push_back(callback);
+                            auto *stats = GetModuleStats(module_lib);
+                            std::lock_guard lk(callbacks_lock);
+                            moduleLoadedCallbacks.push_back({callback, stats});
                             // return directly to avoid module interaction
                             return handle;
                         }
@@ -126,8 +468,20 @@ namespace lspd {
                 }
 
                 // Callbacks
-                for (auto &callback: moduleLoadedCallbacks) {
+                std::vector<ModuleCallback> callbacks;
+                {
+                    // callbacks may dlopen on their own, so do not hold the lock while calling
+                    std::lock_guard lk(callbacks_lock);
+                    callbacks.assign(moduleLoadedCallbacks.begin(), moduleLoadedCallbacks.end());
+                }
+                if (!callbacks.empty()) dlopenDispatched++;
+                for (auto &[callback, stats]: callbacks) {
+                    auto start = std::chrono::steady_clock::now();
                     callback(name, handle);
+                    auto elapsed = std::chrono::steady_clock::now() - start;
+                    stats->callbacks++;
+                    stats->callback_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            elapsed).count();
                 }
                 return handle;
             });
@@ -25,6 +25,7 @@
 #ifndef LSPOSED_NATIVE_API_H
 #define LSPOSED_NATIVE_API_H
 
+#include <cstddef>
 #include <cstdint>
 #include <string>
 
@@ -34,20 +35,73 @@ typedef int (*HookFunType)(void *func, void *replace, void **backup);
 
 typedef int (*UnhookFunType)(void *func);
 
+typedef int (*GotHookFunType)(const char *library, const char *symbol, void *replace, void **backup);
+
+typedef void *(*SymbolLookupFunType)(const char *library, const char *symbol);
+
+typedef int (*BatchSymbolLookupFunType)(const char *library, const char *const *symbols,
+                                        void **results, size_t count);
+
+typedef struct {
+    void *func;
+    void *replace;
+    void **backup;
+} NativeHookRequest;
+
+typedef int (*BatchHookFunType)(const NativeHookRequest *requests, size_t count);
+
 typedef void (*NativeOnModuleLoaded)(const char *name, void *handle);
 
+// Capability bits of NativeAPIEntries::capabilities, one per optional entry
+#define NATIVE_API_CAP_GOT_HOOK        (1u << 0)
+#define NATIVE_API_CAP_SYMBOL_LOOKUP   (1u << 1)
+#define NATIVE_API_CAP_BATCH_HOOK      (1u << 2)
+
 typedef struct {
+    // Layout of version 2, must never change
     uint32_t version;
     HookFunType hookFunc;
     UnhookFunType unhookFunc;
+    // Since version 3. Optional entries are only appended, and an entry is valid only if
+    // size covers it and its capability bit is set.
+    uint32_t size;
+    uint32_t capabilities;
+    GotHookFunType gotHookFunc;
+    SymbolLookupFunType symbolLookupFunc;
+    SymbolLookupFunType symbolPrefixLookupFunc;
+    BatchSymbolLookupFunType batchSymbolLookupFunc;
+    BatchHookFunType batchHookFunc;
 } NativeAPIEntries;
 
+static_assert(offsetof(NativeAPIEntries, version) == 0);
+static_assert(offsetof(NativeAPIEntries, hookFunc) == sizeof(void *));
+static_assert(offsetof(NativeAPIEntries, unhookFunc) == 2 * sizeof(void *));
+static_assert(offsetof(NativeAPIEntries, size) == 3 * sizeof(void *));
+static_assert(offsetof(NativeAPIEntries, capabilities) == 3 * sizeof(void *) + sizeof(uint32_t));
+static_assert(offsetof(NativeAPIEntries, gotHookFunc) == 3 * sizeof(void *) + 2 * sizeof(uint32_t));
+static_assert(sizeof(NativeAPIEntries) == 8 * sizeof(void *) + 2 * sizeof(uint32_t));
+
 typedef NativeOnModuleLoaded (*NativeInit)(const NativeAPIEntries *entries);
 
+// Flags of the optional "native_init_flags" (uint32_t) symbol exported next to "native_init"
+#define NATIVE_INIT_DEFERRABLE 0x1u
+
 namespace lspd {
     bool InstallNativeAPI(const lsplant::HookHandler& handler);
 
     void RegisterNativeLib(const std::string &library_name);
+
+    int GotHookFunction(const char *library, const char *symbol, void *replace, void **backup);
+
+    void *LookupSymbol(const char *library, const char *symbol);
+
+    void *LookupSymbolPrefix(const char *library, const char *prefix);
+
+    int LookupSymbols(const char *library, const char *const *symbols, void **results, size_t count);
+
+    int HookFunctions(const NativeHookRequest *requests, size_t count);
+
+    std::string DumpNativeAPIStats();
 }
 
 #endif //LSPOSED_NATIVE_API_H
@@ -27,10 +27,73 @@
 #include <dobby.h>
 #include "macros.h"
 #include "config.h"
+#include <algorithm>
+#include <cstring>
+#include <link.h>
 #include <vector>
 #include <logging.h>
 
 namespace lspd {
+    namespace {
+        constexpr uint32_t kCacheMagic = 0x4150534c;  // "LSPA"
+        constexpr uint32_t kCacheVersion = 1;
+
+        // All fields in native byte order, each entry is followed by its key
+        struct CacheHeader {
+            uint32_t magic;
+            uint32_t version;
+            uint32_t count;
+        };
+
+        struct CacheEntry {
+            uint64_t offset;
+            uint32_t key_length;
+        };
+
+        struct ArtImage {
+            uintptr_t base = 0;
+            uintptr_t span = 0;
+            std::string build_id;
+        };
+
+        int FindArt(dl_phdr_info *info, [[maybe_unused]] size_t size, void *data) {
+            constexpr std::string_view kArtName = kLibArtName;
+            std::string_view name = info->dlpi_name ? info->dlpi_name : "";
+            if (name.size() <= kArtName.size() || !name.ends_with(kArtName) ||
+                name[name.size() - kArtName.size() - 1] != '/') {
+                return 0;
+            }
+            auto *art = static_cast<ArtImage *>(data);
+            art->base = info->dlpi_addr;
+            for (ElfW(Half) i = 0; i < info->dlpi_phnum; ++i) {
+                const auto &phdr = info->dlpi_phdr[i];
+                if (phdr.p_type == PT_LOAD) {
+                    art->span = std::max<uintptr_t>(art->span, phdr.p_vaddr + phdr.p_memsz);
+                } else if (phdr.p_type == PT_NOTE && art->build_id.empty()) {
+                    auto note = info->dlpi_addr + phdr.p_vaddr;
+                    auto end = note + phdr.p_memsz;
+                    while (note + sizeof(ElfW(Nhdr)) <= end) {
+                        const auto *nhdr = reinterpret_cast<const ElfW(Nhdr) *>(note);
+                        auto desc = note + sizeof(ElfW(Nhdr)) + ((nhdr->n_namesz + 3) & ~3u);
+                        if (desc + nhdr->n_descsz > end) break;
+                        if (nhdr->n_type == NT_GNU_BUILD_ID && nhdr->n_namesz == 4 &&
+                            memcmp(reinterpret_cast<const char *>(nhdr + 1), "GNU", 4) == 0) {
+                            constexpr auto kHex = "0123456789abcdef";
+                            const auto *id = reinterpret_cast<const uint8_t *>(desc);
+                            for (size_t j = 0; j < nhdr->n_descsz; ++j) {
+                                art->build_id += kHex[id[j] >> 4];
+                                art->build_id += kHex[id[j] & 0xf];
+                            }
+                            break;
+                        }
+                        note = desc + ((nhdr->n_descsz + 3) & ~3u);
+                    }
+                }
+            }
+            return 1;
+        }
+    }
+
     std::unique_ptr<const SandHook::ElfImg> &GetArt(bool release) {
         static std::unique_ptr<const SandHook::ElfImg> kArtImg = nullptr;
         if (release) {
@@ -40,4 +103,79 @@ namespace lspd {
         }
         return kArtImg;
     }
+
+    ArtSymbolCache &ArtSymbolCache::GetInstance() {
+        static ArtSymbolCache instance;
+        return instance;
+    }
+
+    ArtSymbolCache::ArtSymbolCache() {
+        ArtImage art;
+        dl_iterate_phdr(&FindArt, &art);
+        base_ = art.base;
+        span_ = art.span;
+        // without a build id there is nothing to tell two builds apart
+        if (span_) build_id_ = std::move(art.build_id);
+    }
+
+    void ArtSymbolCache::Load(std::string_view blob) {
+        if (build_id_.empty() || blob.size() < sizeof(CacheHeader)) return;
+        CacheHeader header;
+        memcpy(&header, blob.data(), sizeof(header));
+        if (header.magic != kCacheMagic || header.version != kCacheVersion) {
+            LOGW("unexpected art symbol cache header");
+            return;
+        }
+        blob.remove_prefix(sizeof(header));
+        for (uint32_t i = 0; i < header.count; ++i) {
+            CacheEntry entry;
+            if (blob.size() < sizeof(entry)) break;
+            memcpy(&entry, blob.data(), sizeof(entry));
+            blob.remove_prefix(sizeof(entry));
+            if (entry.key_length == 0 || blob.size() < entry.key_length) break;
+            auto key = blob.substr(0, entry.key_length);
+            blob.remove_prefix(entry.key_length);
+            if (entry.offset >= span_) continue;
+            offsets_.emplace(key, static_cast<uintptr_t>(entry.offset));
+        }
+        LOGD("loaded {} art symbols of build {}", offsets_.size(), build_id_);
+    }
+
+    std::string ArtSymbolCache::Serialize() const {
+        std::string blob;
+        CacheHeader header{
+                .magic = kCacheMagic,
+                .version = kCacheVersion,
+                .count = static_cast<uint32_t>(offsets_.size()),
+        };
+        blob.append(reinterpret_cast<const char *>(&header), sizeof(header));
+        for (const auto &[key, offset]: offsets_) {
+            CacheEntry entry{
+                    .offset = offset,
+                    .key_length = static_cast<uint32_t>(key.size()),
+            };
+            blob.append(reinterpret_cast<const char *>(&entry), sizeof(entry));
+            blob.append(key);
+        }
+        return blob;
+    }
+
+    void *ArtSymbolCache::Resolve(std::string_view symbol, bool prefix) {
+        std::string key;
+        key.reserve(symbol.size() + 1);
+        key += prefix ? 'P' : 'S';
+        key += symbol;
+        if (auto i = offsets_.find(key); i != offsets_.end()) {
+            return i->second ? reinterpret_cast<void *>(base_ + i->second) : nullptr;
+        }
+        auto *addr = prefix ? GetArt()->getSymbPrefixFirstAddress(symbol) :
+                     GetArt()->getSymbAddress(symbol);
+        auto offset = reinterpret_cast<uintptr_t>(addr) - base_;
+        // only cache what is known to be relative to the libart we found
+        if (!build_id_.empty() && (!addr || offset < span_)) {
+            offsets_.emplace(std::move(key), addr ? offset : 0);
+            dirty_ = true;
+        }
+        return addr;
+    }
 }  // namespace lspd
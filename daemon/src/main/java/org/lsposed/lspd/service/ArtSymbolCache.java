@@ -0,0 +1,88 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2022 LSPosed Contributors
+ */
+
+package org.lsposed.lspd.service;
+
+import static org.lsposed.lspd.service.ServiceManager.TAG;
+
+import android.util.Log;
+
+import java.io.IOException;
+import java.nio.file.Files;
+import java.nio.file.Path;
+import java.nio.file.StandardCopyOption;
+import java.util.regex.Pattern;
+
+// libart symbols resolved by lsplant, recorded by system_server and served to every injected
+// process on the same libart build. The content is opaque to us and validated by the loader,
+// see ArtSymbolCache in core/src/main/jni/src/symbol_cache.cpp
+public class ArtSymbolCache {
+    private static final Path cacheDirPath = ConfigFileManager.basePath.resolve("cache");
+    private static final Pattern BUILD_ID = Pattern.compile("[0-9a-f]{8,128}");
+    private static final int MAX_SIZE = 256 * 1024;
+
+    private static String buildId = null;
+    private static byte[] symbols = null;
+
+    private static Path pathOf(String buildId) {
+        return cacheDirPath.resolve("art-" + buildId);
+    }
+
+    synchronized static byte[] get(String buildId) {
+        if (buildId == null || !BUILD_ID.matcher(buildId).matches()) return null;
+        if (!buildId.equals(ArtSymbolCache.buildId)) {
+            ArtSymbolCache.buildId = buildId;
+            try {
+                var path = pathOf(buildId);
+                symbols = Files.isRegularFile(path) && Files.size(path) <= MAX_SIZE ? Files.readAllBytes(path) : null;
+            } catch (IOException e) {
+                Log.w(TAG, "read art symbols", e);
+                symbols = null;
+            }
+        }
+        return symbols;
+    }
+
+    synchronized static void put(String buildId, byte[] symbols) {
+        if (buildId == null || !BUILD_ID.matcher(buildId).matches() ||
+                symbols == null || symbols.length == 0 || symbols.length > MAX_SIZE) {
+            return;
+        }
+        ArtSymbolCache.buildId = buildId;
+        ArtSymbolCache.symbols = symbols;
+        try {
+            Files.createDirectories(cacheDirPath);
+            // a new build id means libart was updated, the old caches are of no use
+            try (var l = Files.list(cacheDirPath)) {
+                l.filter(p -> p.getFileName().toString().startsWith("art-")).forEach(p -> {
+                    try {
+                        Files.delete(p);
+                    } catch (IOException ignored) {
+                    }
+                });
+            }
+            var tmp = cacheDirPath.resolve("art.tmp");
+            Files.write(tmp, symbols);
+            Files.move(tmp, pathOf(buildId), StandardCopyOption.REPLACE_EXISTING, StandardCopyOption.ATOMIC_MOVE);
+            Log.d(TAG, "cached " + symbols.length + " bytes of art symbols for " + buildId);
+        } catch (IOException e) {
+            Log.w(TAG, "write art symbols", e);
+        }
+    }
+}
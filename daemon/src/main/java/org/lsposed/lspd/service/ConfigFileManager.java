@@ -51,9 +51,11 @@ import java.io.InputStream;
 import java.io.InputStreamReader;
 import java.io.OutputStream;
 import java.lang.reflect.Method;
+import java.nio.ByteOrder;
 import java.nio.channels.Channels;
 import java.nio.channels.FileChannel;
 import java.nio.channels.FileLock;
+import java.nio.charset.StandardCharsets;
 import java.nio.file.FileVisitResult;
 import java.nio.file.Files;
 import java.nio.file.LinkOption;
@@ -70,6 +72,7 @@ import java.util.ArrayList;
 import java.util.HashSet;
 import java.util.List;
 import java.util.Locale;
+import java.util.Properties;
 import java.util.zip.Deflater;
 import java.util.zip.ZipEntry;
 import java.util.zip.ZipFile;
@@ -95,6 +98,12 @@ public class ConfigFileManager {
     private static Resources res = null;
     private static ParcelFileDescriptor fd = null;
     private static SharedMemory preloadDex = null;
+    private static boolean preloadDexObfuscated = true;
+    // Present while the framework dex is served as is, the loader only maps framework/lspd.dex
+    // ahead of time (in zygote for Riru, in injected children for Zygisk) when it finds this
+    // from our previous start
+    private static final Path plainDexMarkerPath = Paths.get("framework/lspd.dex.plain");
+    private static final SharedMemory[] obfuscationMaps = new SharedMemory[2];
 
     static {
         try {
@@ -276,6 +285,8 @@ public class ConfigFileManager {
             }
             zipAddFile(os, dbPath.toPath(), configDirPath);
             ConfigManager.getInstance().exportScopes(os);
+            StartupProfiles.export(os);
+            LSPApplicationService.exportNativeStats(os);
         } catch (Throwable e) {
             Log.w(TAG, "get log", e);
             throw new IllegalStateException(e);
@@ -376,6 +387,21 @@ public class ConfigFileManager {
         }
     }
 
+    // Modern modules may opt in to be loaded off the main thread with asyncInit=true. Such a module
+    // must not rely on hooks placed in its constructor catching anything before handleBindApplication
+    private static boolean readAsyncInit(ZipFile apkFile) {
+        var propEntry = apkFile.getEntry("META-INF/xposed/module.prop");
+        if (propEntry == null) return false;
+        try (var in = apkFile.getInputStream(propEntry)) {
+            var prop = new Properties();
+            prop.load(in);
+            return "true".equals(prop.getProperty("asyncInit"));
+        } catch (IOException | IllegalArgumentException e) {
+            Log.e(TAG, "Can not read " + propEntry, e);
+            return false;
+        }
+    }
+
     @Nullable
     static PreLoadedApk loadModule(String path, boolean obfuscate) {
         if (path == null) return null;
@@ -393,6 +419,7 @@ public class ConfigFileManager {
             } else {
                 file.legacy = false;
                 readName(apkFile, "META-INF/xposed/native_init.list", moduleLibraryNames);
+                file.asyncInit = readAsyncInit(apkFile);
             }
         } catch (IOException e) {
             Log.e(TAG, "Can not open " + path, e);
@@ -439,13 +466,94 @@ public class ConfigFileManager {
         if (preloadDex == null) {
             try (var is = new FileInputStream("framework/lspd.dex")) {
                 preloadDex = readDex(is, obfuscate);
+                preloadDexObfuscated = obfuscate;
             } catch (Throwable e) {
                 Log.e(TAG, "preload dex", e);
             }
+            try {
+                if (obfuscate) {
+                    Files.deleteIfExists(plainDexMarkerPath);
+                } else if (Files.notExists(plainDexMarkerPath)) {
+                    Files.createFile(plainDexMarkerPath);
+                }
+            } catch (IOException e) {
+                Log.w(TAG, "plain dex marker", e);
+            }
         }
         return preloadDex;
     }
 
+    // Whether the framework dex we serve differs from framework/lspd.dex
+    synchronized static boolean isPreloadDexObfuscated() {
+        return preloadDexObfuscated;
+    }
+
+    // Packed as: int32 magic, int32 version, int32 count, then count * (int32 offset, int32 length)
+    // of the names, then the UTF-8 names each terminated by a NUL, all in native byte order so
+    // that injected processes parse it without any JNI call.
+    // Same order as ObfuscationKey in config_bridge.h
+    private static final String[] OBFUSCATION_KEYS = {
+            "de.robv.android.xposed.",
+            "android.app.AndroidApp",
+            "android.content.res.XRes",
+            "android.content.res.XModule",
+            "org.lsposed.lspd.core.",
+            "org.lsposed.lspd.nativebridge.",
+            "org.lsposed.lspd.service.",
+    };
+    private static final int OBFUSCATION_MAP_MAGIC = 0x4e50534c;
+    private static final int OBFUSCATION_MAP_VERSION = 1;
+
+    // Final names the loader looks up, so that it never builds them from the prefixes.
+    // Layout must match core/src/main/jni/src/config_bridge.cpp
+    synchronized static SharedMemory getObfuscationMap(boolean obfuscate) {
+        int index = obfuscate ? 1 : 0;
+        if (obfuscationMaps[index] == null) {
+            try {
+                var signatures = ObfuscationManager.getSignatures();
+                var names = new ArrayList<String>(OBFUSCATION_KEYS.length + 3);
+                for (var key : OBFUSCATION_KEYS) {
+                    // value = key if obfuscation disabled
+                    var value = obfuscate ? signatures.get(key) : key;
+                    names.add(value != null ? value : key);
+                }
+                // ObfuscatedClass in config_bridge.h
+                names.add(names.get(4) /* core */ + "Main");
+                names.add(names.get(6) /* service */ + "BridgeService");
+                names.add(names.get(2) /* XRes */.replace('.', '/') + "ources");
+
+                var strings = new ArrayList<byte[]>(names.size());
+                int size = 3 * Integer.BYTES + names.size() * 2 * Integer.BYTES;
+                int offset = size;
+                for (var name : names) {
+                    var bytes = name.getBytes(StandardCharsets.UTF_8);
+                    strings.add(bytes);
+                    size += bytes.length + 1;
+                }
+                var memory = SharedMemory.create(null, size);
+                var byteBuffer = memory.mapReadWrite().order(ByteOrder.nativeOrder());
+                byteBuffer.putInt(OBFUSCATION_MAP_MAGIC);
+                byteBuffer.putInt(OBFUSCATION_MAP_VERSION);
+                byteBuffer.putInt(strings.size());
+                for (var bytes : strings) {
+                    byteBuffer.putInt(offset);
+                    byteBuffer.putInt(bytes.length);
+                    offset += bytes.length + 1;
+                }
+                for (var bytes : strings) {
+                    byteBuffer.put(bytes);
+                    byteBuffer.put((byte) 0);
+                }
+                SharedMemory.unmap(byteBuffer);
+                memory.setProtect(OsConstants.PROT_READ);
+                obfuscationMaps[index] = memory;
+            } catch (Throwable e) {
+                Log.e(TAG, "obfuscation map", e);
+            }
+        }
+        return obfuscationMaps[index];
+    }
+
     static void ensureModuleFilePath(String path) throws RemoteException {
         if (path == null || path.indexOf(File.separatorChar) >= 0 || ".".equals(path) || "..".equals(path)) {
             throw new RemoteException("Invalid path: " + path);
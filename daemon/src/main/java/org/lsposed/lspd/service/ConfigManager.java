@@ -303,6 +303,7 @@ public class ConfigManager {
     public synchronized void updateManager(boolean uninstalled) {
         if (uninstalled) {
             managerUid = -1;
+            updateScopeBitmap();
             return;
         }
         if (!PackageService.isAlive()) return;
@@ -316,6 +317,7 @@ public class ConfigManager {
             }
         } catch (RemoteException ignored) {
         }
+        updateScopeBitmap();
     }
 
     static ConfigManager getInstance() {
@@ -524,6 +526,7 @@ public class ConfigManager {
         }
         cachedModule.clear();
         cachedScope.clear();
+        ScopeBitmap.invalidate();
     }
 
     private synchronized void cacheModules() {
@@ -733,6 +736,16 @@ public class ConfigManager {
             Log.d(TAG, ps.processName + "/" + ps.uid);
             modules.forEach(module -> Log.d(TAG, "\t" + module.packageName));
         });
+        updateScopeBitmap();
+    }
+
+    // Every uid that shouldSkipProcess may let through, see ScopeBitmap
+    private synchronized void updateScopeBitmap() {
+        var uids = new HashSet<Integer>();
+        cachedScope.keySet().forEach(scope -> uids.add(scope.uid));
+        uids.add(managerUid);
+        uids.add(BuildConfig.MANAGER_INJECTED_UID);
+        ScopeBitmap.update(uids);
     }
 
     // This is called when a new process created, use the cached result
@@ -1202,4 +1215,12 @@ public class ConfigManager {
     synchronized SharedMemory getPreloadDex() {
         return ConfigFileManager.getPreloadDex(dexObfuscate);
     }
+
+    boolean isPreloadDexObfuscated() {
+        return ConfigFileManager.isPreloadDexObfuscated();
+    }
+
+    SharedMemory getObfuscationMap() {
+        return ConfigFileManager.getObfuscationMap(dexObfuscate());
+    }
 }
@@ -26,6 +26,7 @@ import android.os.Parcel;
 import android.os.ParcelFileDescriptor;
 import android.os.Process;
 import android.os.RemoteException;
+import android.os.SystemClock;
 import android.util.Log;
 import android.util.Pair;
 
@@ -33,15 +34,33 @@ import androidx.annotation.NonNull;
 
 import org.lsposed.lspd.models.Module;
 
+import java.io.IOException;
+import java.nio.charset.StandardCharsets;
 import java.util.Collections;
 import java.util.List;
+import java.util.Locale;
 import java.util.Map;
 import java.util.concurrent.ConcurrentHashMap;
+import java.util.concurrent.ExecutionException;
+import java.util.concurrent.Executors;
+import java.util.concurrent.TimeUnit;
+import java.util.concurrent.TimeoutException;
+import java.util.concurrent.atomic.AtomicBoolean;
 import java.util.stream.Collectors;
+import java.util.zip.ZipEntry;
+import java.util.zip.ZipOutputStream;
 
 public class LSPApplicationService extends ILSPApplicationService.Stub {
-    final static int DEX_TRANSACTION_CODE = 1310096052;
-    final static int OBFUSCATION_MAP_TRANSACTION_CODE = 724533732;
+    final static int BOOTSTRAP_TRANSACTION_CODE = 1281652293;
+    // ('_' << 24) | ('L' << 16) | ('S' << 8) | 'R'
+    final static int STARTUP_RECORD_TRANSACTION_CODE = 1598837586;
+    // ('_' << 24) | ('L' << 16) | ('S' << 8) | 'N'
+    final static int NATIVE_STATS_TRANSACTION_CODE = 1598837582;
+    // ('_' << 24) | ('L' << 16) | ('S' << 8) | 'A'
+    final static int ART_SYMBOLS_TRANSACTION_CODE = 1598837569;
+    // NativeAPI.DUMP_STATS_TRANSACTION_CODE
+    private final static int DUMP_STATS_TRANSACTION_CODE = IBinder.FIRST_CALL_TRANSACTION;
+    private final static long NATIVE_STATS_TIMEOUT_MS = 3000;
     // key: <uid, pid>
     private final static Map<Pair<Integer, Integer>, ProcessInfo> processes = new ConcurrentHashMap<>();
 
@@ -50,6 +69,10 @@ public class LSPApplicationService extends ILSPApplicationService.Stub {
         final int pid;
         final String processName;
         final IBinder heartBeat;
+        // a process reports its startup only once
+        final AtomicBoolean profiled = new AtomicBoolean(false);
+        // set once the process loaded a native module, see NativeAPI.recordNativeEntrypoints
+        volatile IBinder nativeStats = null;
 
         ProcessInfo(int uid, int pid, String processName, IBinder heartBeat) throws RemoteException {
             this.uid = uid;
@@ -84,30 +107,103 @@ public class LSPApplicationService extends ILSPApplicationService.Stub {
     public boolean onTransact(int code, Parcel data, Parcel reply, int flags) throws RemoteException {
         Log.d(TAG, "LSPApplicationService.onTransact: code=" + code);
         switch (code) {
-            case DEX_TRANSACTION_CODE: {
-                var shm = ConfigManager.getInstance().getPreloadDex();
-                if (shm == null) return false;
-                // assume that write only a fd
-                shm.writeToParcel(reply, 0);
-                reply.writeLong(shm.getSize());
+            case BOOTSTRAP_TRANSACTION_CODE: {
+                var dex = ConfigManager.getInstance().getPreloadDex();
+                var obfuscationMap = ConfigManager.getInstance().getObfuscationMap();
+                if (dex == null || obfuscationMap == null) return false;
+                // the loader already has framework/lspd.dex preloaded, which is only
+                // of use if we serve it as is
+                boolean hasDex = data.dataAvail() >= Integer.BYTES && data.readInt() != 0;
+                var artBuildId = data.dataAvail() > 0 ? data.readString() : null;
+                if (hasDex && !ConfigManager.getInstance().isPreloadDexObfuscated()) {
+                    reply.writeLong(0);
+                } else {
+                    reply.writeLong(dex.getSize());
+                    // assume that write only a fd
+                    dex.writeToParcel(reply, 0);
+                }
+                obfuscationMap.writeToParcel(reply, 0);
+                reply.writeLong(obfuscationMap.getSize());
+                reply.writeByteArray(ArtSymbolCache.get(artBuildId));
+                return true;
+            }
+            case STARTUP_RECORD_TRANSACTION_CODE: {
+                // oneway, so the pid comes from the caller and is only trusted together with
+                // the uid it registered with
+                var processInfo = processes.get(new Pair<>(getCallingUid(), data.readInt()));
+                if (processInfo == null || !processInfo.profiled.compareAndSet(false, true)) {
+                    Log.w(TAG, "unexpected startup record from uid " + getCallingUid());
+                    return true;
+                }
+                StartupProfiles.publish(processInfo.uid, processInfo.pid, processInfo.processName, data);
                 return true;
             }
-            case OBFUSCATION_MAP_TRANSACTION_CODE: {
-                var obfuscation = ConfigManager.getInstance().dexObfuscate();
-                var signatures = ObfuscationManager.getSignatures();
-                reply.writeInt(signatures.size() * 2);
-                for (Map.Entry<String, String> entry : signatures.entrySet()) {
-                    reply.writeString(entry.getKey());
-                    // return val = key if obfuscation disabled
-                    reply.writeString(obfuscation ? entry.getValue() : entry.getKey());
+            case ART_SYMBOLS_TRANSACTION_CODE: {
+                // oneway as well, and only system_server is trusted with what every app hooks
+                var processInfo = processes.get(new Pair<>(getCallingUid(), data.readInt()));
+                if (processInfo == null || processInfo.uid != Process.SYSTEM_UID ||
+                        !processInfo.processName.equals("system")) {
+                    Log.w(TAG, "unexpected art symbols from uid " + getCallingUid());
+                    return true;
                 }
+                var buildId = data.readString();
+                ArtSymbolCache.put(buildId, data.createByteArray());
+                return true;
+            }
+            case NATIVE_STATS_TRANSACTION_CODE: {
+                ensureRegistered().nativeStats = data.readStrongBinder();
                 return true;
             }
         }
         return super.onTransact(code, data, reply, flags);
     }
 
+    // Pulls the native API stats of every process that loaded a native module. A process that
+    // does not answer in time is left out rather than blocking the export.
+    static void exportNativeStats(ZipOutputStream os) throws IOException {
+        var executor = Executors.newSingleThreadExecutor();
+        var deadline = SystemClock.elapsedRealtime() + NATIVE_STATS_TIMEOUT_MS;
+        os.putNextEntry(new ZipEntry("native_api.txt"));
+        try {
+            for (var processInfo : processes.values()) {
+                var stats = processInfo.nativeStats;
+                if (stats == null) continue;
+                var future = executor.submit(() -> {
+                    var data = Parcel.obtain();
+                    var reply = Parcel.obtain();
+                    try {
+                        return stats.transact(DUMP_STATS_TRANSACTION_CODE, data, reply, 0) ? reply.readString() : null;
+                    } finally {
+                        data.recycle();
+                        reply.recycle();
+                    }
+                });
+                String dump;
+                try {
+                    dump = future.get(Math.max(deadline - SystemClock.elapsedRealtime(), 0), TimeUnit.MILLISECONDS);
+                } catch (TimeoutException e) {
+                    Log.w(TAG, "native api stats of " + processInfo + " timed out");
+                    break;
+                } catch (ExecutionException | InterruptedException e) {
+                    continue;
+                }
+                if (dump == null) continue;
+                os.write(String.format(Locale.ROOT, "%s/%d pid=%d\n%s\n",
+                        processInfo.processName, processInfo.uid, processInfo.pid, dump).getBytes(StandardCharsets.UTF_8));
+            }
+        } finally {
+            executor.shutdownNow();
+            os.closeEntry();
+        }
+    }
+
     public boolean registerHeartBeat(int uid, int pid, String processName, IBinder heartBeat) {
+        // a process reuses its heartbeat for every request, keep a single death recipient
+        var existing = processes.get(new Pair<>(uid, pid));
+        if (existing != null) {
+            if (existing.heartBeat.equals(heartBeat)) return true;
+            existing.binderDied();
+        }
         try {
             new ProcessInfo(uid, pid, processName, heartBeat);
             return true;
@@ -110,8 +110,8 @@ public class LSPSystemServerService extends ILSPSystemServerService.Stub impleme
                     return false;
                 }
             }
-            case LSPApplicationService.OBFUSCATION_MAP_TRANSACTION_CODE, LSPApplicationService.DEX_TRANSACTION_CODE -> {
-                // Proxy LSP dex transaction to Application Binder
+            case LSPApplicationService.BOOTSTRAP_TRANSACTION_CODE -> {
+                // Proxy LSP bootstrap transaction to Application Binder
                 return ServiceManager.getApplicationService().onTransact(code, data, reply, flags);
             }
             default -> {
@@ -95,6 +95,7 @@ public class LSPosedService extends ILSPosedService.Stub {
         }
         if (!ServiceManager.getManagerService().shouldStartManager(pid, uid, processName) && ConfigManager.getInstance().shouldSkipProcess(new ConfigManager.ProcessScope(processName, uid))) {
             Log.d(TAG, "Skipped " + processName + "/" + uid);
+            StartupProfiles.recordDeclined(processName);
             return null;
         }
         Log.d(TAG, "returned service");
@@ -0,0 +1,116 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2022 LSPosed Contributors
+ */
+
+package org.lsposed.lspd.service;
+
+import static org.lsposed.lspd.service.PackageService.PER_USER_RANGE;
+import static org.lsposed.lspd.service.ServiceManager.TAG;
+
+import android.annotation.SuppressLint;
+import android.os.Build;
+import android.util.Log;
+
+import java.lang.invoke.VarHandle;
+import java.nio.ByteOrder;
+import java.nio.MappedByteBuffer;
+import java.nio.channels.FileChannel;
+import java.nio.file.Paths;
+import java.nio.file.StandardOpenOption;
+import java.util.concurrent.atomic.AtomicInteger;
+
+// One bit per app id that may be injected, read by the loader from the module directory so that
+// out of scope processes are skipped without asking us. Riru maps it once in zygote, Zygisk in
+// the pre hook of every forked app. The file is created by post-fs-data.sh before
+// zygote starts and only ever rewritten in place, otherwise zygote would keep the stale inode.
+// Layout must match magisk-loader/src/main/jni/src/scope_bitmap.cpp
+public class ScopeBitmap {
+    private static final int MAGIC = 0x4250534c;
+    private static final int VERSION = 1;
+    private static final int HEADER_SIZE = 16;
+    private static final int OFFSET_GENERATION = 8;
+    private static final int SIZE = HEADER_SIZE + PER_USER_RANGE / 8;
+
+    private static MappedByteBuffer buffer = null;
+    private static boolean unavailable = false;
+    private static final AtomicInteger barrier = new AtomicInteger();
+
+    private static MappedByteBuffer getBuffer() {
+        if (buffer == null && !unavailable) {
+            try (var channel = FileChannel.open(Paths.get("scope.bin"),
+                    StandardOpenOption.READ, StandardOpenOption.WRITE)) {
+                if (channel.size() < SIZE) throw new IllegalStateException("size " + channel.size());
+                buffer = channel.map(FileChannel.MapMode.READ_WRITE, 0, SIZE);
+                buffer.order(ByteOrder.nativeOrder());
+            } catch (Throwable e) {
+                // zygote falls back to asking us for every process
+                Log.w(TAG, "scope bitmap", e);
+                unavailable = true;
+            }
+        }
+        return buffer;
+    }
+
+    // Buffer accesses are plain stores, zygote must never see the bits of an update without the
+    // odd generation in front of them or the even generation without all the bits behind it
+    @SuppressLint("NewApi")
+    private static void fullFence() {
+        if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.P) {
+            // public since Android 13, but present in the runtime since Android 9
+            VarHandle.fullFence();
+        } else {
+            // a volatile store followed by a volatile load orders everything around them on ART
+            barrier.set(0);
+            barrier.get();
+        }
+    }
+
+    private static int beginUpdate(MappedByteBuffer buffer) {
+        int generation = buffer.getInt(OFFSET_GENERATION);
+        if ((generation & 1) == 0) buffer.putInt(OFFSET_GENERATION, ++generation);
+        fullFence();
+        return generation;
+    }
+
+    // Makes zygote ask us for every process until the next update
+    synchronized static void invalidate() {
+        var buffer = getBuffer();
+        if (buffer == null) return;
+        beginUpdate(buffer);
+    }
+
+    synchronized static void update(Iterable<Integer> uids) {
+        var buffer = getBuffer();
+        if (buffer == null) return;
+        var bits = new byte[PER_USER_RANGE / 8];
+        for (int uid : uids) {
+            if (uid < 0) continue;
+            int appId = uid % PER_USER_RANGE;
+            bits[appId / 8] |= (byte) (1 << (appId % 8));
+        }
+        int generation = beginUpdate(buffer);
+        buffer.putInt(0, MAGIC);
+        buffer.putInt(4, VERSION);
+        buffer.putInt(12, PER_USER_RANGE);
+        buffer.position(HEADER_SIZE);
+        buffer.put(bits);
+        fullFence();
+        // skip 0, which tells zygote that we never published a bitmap
+        buffer.putInt(OFFSET_GENERATION, generation + 1 == 0 ? 2 : generation + 1);
+    }
+}
@@ -0,0 +1,236 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2022 LSPosed Contributors
+ */
+
+package org.lsposed.lspd.service;
+
+import static org.lsposed.lspd.service.ServiceManager.TAG;
+
+import android.os.Parcel;
+import android.os.Process;
+import android.os.SystemClock;
+import android.util.Log;
+
+import androidx.annotation.NonNull;
+
+import org.json.JSONException;
+import org.json.JSONObject;
+
+import java.io.IOException;
+import java.nio.charset.StandardCharsets;
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.List;
+import java.util.Locale;
+import java.util.Map;
+import java.util.TreeMap;
+import java.util.concurrent.ConcurrentHashMap;
+import java.util.zip.ZipEntry;
+import java.util.zip.ZipOutputStream;
+
+// Startup records of the injected processes, sent by the loader once the injection is done.
+// Fields must match Service::SendStartupRecord in magisk-loader/src/main/jni/src/service.cpp
+public class StartupProfiles {
+    private static final int CAPACITY = 512;
+
+    static final int FLAG_SYSTEM_SERVER = 1;
+    static final int FLAG_DEX_WILL_NEED = 1 << 1;
+    static final int FLAG_DEX_FROM_ZYGOTE = 1 << 2;
+    // Same order as StartupPhase in startup_profiler.h
+    static final String[] PHASES = {
+            "binder", "bootstrap", "loadDex", "initArtHooker", "initHooks", "setupEntryClass", "forkCommon"
+    };
+
+    private static final Record[] ring = new Record[CAPACITY];
+    private static long published = 0;
+    // Processes that asked for injection and were declined by us, by package. Processes skipped
+    // by zygote on its own (isolated, out of the scope bitmap) never reach the daemon.
+    private static final Map<String, Integer> declined = new ConcurrentHashMap<>();
+
+    public static class Record {
+        public final int uid;
+        public final int pid;
+        public final int flags;
+        public final int[] phaseUs;
+        public final int totalUs;
+        public final int minorFaults;
+        public final int hooks;
+        public final String processName;
+
+        private Record(int uid, int pid, String processName, Parcel data) {
+            this.uid = uid;
+            this.pid = pid;
+            this.processName = processName;
+            // only the registration tells whether this is system_server
+            int flags = data.readInt() & ~FLAG_SYSTEM_SERVER;
+            if (uid == Process.SYSTEM_UID && processName.equals("system")) flags |= FLAG_SYSTEM_SERVER;
+            this.flags = flags;
+            // the loader clamps every value to a non-negative int
+            hooks = Math.max(data.readInt(), 0);
+            totalUs = Math.max(data.readInt(), 0);
+            minorFaults = Math.max(data.readInt(), 0);
+            int count = Math.min(data.readInt(), PHASES.length);
+            phaseUs = new int[PHASES.length];
+            for (int i = 0; i < count; i++) phaseUs[i] = Math.max(data.readInt(), 0);
+        }
+
+        public String packageName() {
+            int colon = processName.indexOf(':');
+            return colon < 0 ? processName : processName.substring(0, colon);
+        }
+
+        public String dexPolicy() {
+            if ((flags & FLAG_DEX_FROM_ZYGOTE) != 0) return "zygote";
+            if ((flags & FLAG_DEX_WILL_NEED) != 0) return "willneed";
+            return "plain";
+        }
+
+        @NonNull
+        @Override
+        public String toString() {
+            var sb = new StringBuilder();
+            sb.append(String.format(Locale.ROOT, "%s/%d pid=%d total=%dus faults=%d hooks=%d dex=%s",
+                    processName, uid, pid, totalUs, minorFaults, hooks, dexPolicy()));
+            for (int i = 0; i < PHASES.length; i++) {
+                sb.append(' ').append(PHASES[i]).append('=').append(phaseUs[i]).append("us");
+            }
+            return sb.toString();
+        }
+    }
+
+    // uid, pid and processName come from the registration of the sender, not from data
+    static void publish(int uid, int pid, String processName, Parcel data) {
+        var record = new Record(uid, pid, processName, data);
+        synchronized (ring) {
+            ring[(int) (published++ % CAPACITY)] = record;
+        }
+    }
+
+    // Returns the records currently in the ring, oldest first
+    static List<Record> collect() {
+        synchronized (ring) {
+            var records = new ArrayList<Record>(CAPACITY);
+            for (long i = Math.max(0, published - CAPACITY); i < published; i++) {
+                records.add(ring[(int) (i % CAPACITY)]);
+            }
+            return records;
+        }
+    }
+
+    static void recordDeclined(String processName) {
+        int colon = processName.indexOf(':');
+        declined.merge(colon < 0 ? processName : processName.substring(0, colon), 1, Integer::sum);
+    }
+
+    // Number of processes that published a record since boot, including overwritten ones
+    private static long publishedCount() {
+        synchronized (ring) {
+            return published;
+        }
+    }
+
+    private static JSONObject percentiles(int[] values) throws JSONException {
+        Arrays.sort(values);
+        long sum = 0;
+        for (int value : values) sum += value;
+        var json = new JSONObject();
+        json.put("p50", percentile(values, 50));
+        json.put("p95", percentile(values, 95));
+        json.put("max", values.length == 0 ? 0 : values[values.length - 1]);
+        json.put("sum", sum);
+        return json;
+    }
+
+    // nearest rank
+    private static int percentile(int[] sorted, int p) {
+        if (sorted.length == 0) return 0;
+        int rank = (int) Math.ceil(p / 100.0 * sorted.length);
+        return sorted[Math.max(rank, 1) - 1];
+    }
+
+    private static JSONObject summarize(List<Record> records) throws JSONException {
+        var json = new JSONObject();
+        json.put("count", records.size());
+        int n = records.size();
+        json.put("totalUs", percentiles(records.stream().mapToInt(r -> r.totalUs).toArray()));
+        var phases = new JSONObject();
+        for (int i = 0; i < PHASES.length; i++) {
+            var values = new int[n];
+            for (int j = 0; j < n; j++) values[j] = records.get(j).phaseUs[i];
+            phases.put(PHASES[i] + "Us", percentiles(values));
+        }
+        json.put("phases", phases);
+        json.put("minorFaults", percentiles(records.stream().mapToInt(r -> r.minorFaults).toArray()));
+        json.put("hooks", percentiles(records.stream().mapToInt(r -> r.hooks).toArray()));
+        return json;
+    }
+
+    // Aggregated cost of the framework since boot. Durations are in microseconds and the
+    // percentiles only cover the records still in the ring.
+    static JSONObject report() throws JSONException {
+        var records = collect();
+        var json = new JSONObject();
+        json.put("version", 1);
+        json.put("elapsedRealtimeMs", SystemClock.elapsedRealtime());
+        json.put("published", publishedCount());
+        json.put("recorded", records.size());
+        int declinedTotal = 0;
+        var declinedJson = new JSONObject();
+        for (var entry : new TreeMap<>(declined).entrySet()) {
+            declinedTotal += entry.getValue();
+            declinedJson.put(entry.getKey(), entry.getValue());
+        }
+        json.put("declined", declinedTotal);
+        json.put("declinedByPackage", declinedJson);
+        json.put("all", summarize(records));
+
+        var dexPolicies = new JSONObject();
+        var byPolicy = new TreeMap<String, List<Record>>();
+        for (var record : records) {
+            byPolicy.computeIfAbsent(record.dexPolicy(), k -> new ArrayList<>()).add(record);
+        }
+        for (var entry : byPolicy.entrySet()) dexPolicies.put(entry.getKey(), summarize(entry.getValue()));
+        json.put("dexPolicies", dexPolicies);
+
+        var packages = new JSONObject();
+        var byPackage = new TreeMap<String, List<Record>>();
+        for (var record : records) {
+            var name = (record.flags & FLAG_SYSTEM_SERVER) != 0 ? "system_server" : record.packageName();
+            byPackage.computeIfAbsent(name, k -> new ArrayList<>()).add(record);
+        }
+        for (var entry : byPackage.entrySet()) packages.put(entry.getKey(), summarize(entry.getValue()));
+        json.put("packages", packages);
+        return json;
+    }
+
+    static void export(ZipOutputStream os) throws IOException {
+        os.putNextEntry(new ZipEntry("startup.txt"));
+        for (var record : collect()) {
+            os.write((record + "\n").getBytes(StandardCharsets.UTF_8));
+        }
+        os.closeEntry();
+        try {
+            var report = report().toString(2);
+            os.putNextEntry(new ZipEntry("startup.json"));
+            os.write(report.getBytes(StandardCharsets.UTF_8));
+            os.closeEntry();
+        } catch (JSONException e) {
+            Log.w(TAG, "startup report", e);
+        }
+    }
+}
@@ -23,4 +23,9 @@ rm -f "/data/local/tmp/daemon.apk"
 rm -f "/data/local/tmp/manager.apk"
 cd "$MODDIR"
 
+# Scope bitmap mapped by zygote and rewritten in place by the daemon
+rm -f scope.bin
+dd if=/dev/zero of=scope.bin bs=4096 count=4 2>/dev/null
+chcon u:object_r:system_file:s0 scope.bin
+
 unshare --propagation slave -m sh -c "$MODDIR/daemon $@&"
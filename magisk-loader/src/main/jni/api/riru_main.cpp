@@ -22,6 +22,7 @@
 #include <cstring>
 #include <cstdlib>
 #include <array>
+#include <fcntl.h>
 #include "logging.h"
 #include "loader.h"
 #include "config_impl.h"
@@ -44,6 +45,14 @@ namespace lspd {
             LOGI("onModuleLoaded: version v{} ({})", versionName, versionCode);
             MagiskLoader::Init();
             ConfigImpl::Init();
+            // left by the daemon while it serves the framework dex unobfuscated
+            if (access((magiskPath + "/framework/lspd.dex.plain").c_str(), F_OK) == 0) {
+                MagiskLoader::GetInstance()->PreloadFrameworkDex(
+                        open((magiskPath + "/framework/lspd.dex").c_str(), O_RDONLY | O_CLOEXEC),
+                        true);
+            }
+            MagiskLoader::GetInstance()->MapScopeBitmap(
+                    open((magiskPath + "/scope.bin").c_str(), O_RDONLY | O_CLOEXEC));
         }
 
         void nativeForkAndSpecializePre(JNIEnv *env, jclass, jint *_uid, jint *,
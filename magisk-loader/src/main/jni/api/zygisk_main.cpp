@@ -44,10 +44,26 @@ namespace lspd {
             ConfigImpl::Init();
         }
 
+        // Already in the child, so only injected processes map it. The module dir is not
+        // accessible any more after the pre hooks.
+        void PreloadFrameworkDex() {
+            // left by the daemon while it serves the framework dex unobfuscated
+            if (faccessat(api_->getModuleDir(), "framework/lspd.dex.plain", F_OK, 0) == 0) {
+                MagiskLoader::GetInstance()->PreloadFrameworkDex(
+                        openat(api_->getModuleDir(), "framework/lspd.dex", O_RDONLY | O_CLOEXEC),
+                        false);
+            }
+        }
+
         void preAppSpecialize(zygisk::AppSpecializeArgs *args) override {
-            MagiskLoader::GetInstance()->OnNativeForkAndSpecializePre(
+            MagiskLoader::GetInstance()->MapScopeBitmap(
+                    openat(api_->getModuleDir(), "scope.bin", O_RDONLY | O_CLOEXEC));
+            auto inject = MagiskLoader::GetInstance()->OnNativeForkAndSpecializePre(
                     env_, args->uid, args->gids, args->nice_name,
                     args->is_child_zygote ? *args->is_child_zygote : false, args->app_data_dir);
+            // this is the child already, nothing is left to decide with the bitmap
+            MagiskLoader::GetInstance()->ReleaseScopeBitmap();
+            if (inject) PreloadFrameworkDex();
         }
 
         void postAppSpecialize(const zygisk::AppSpecializeArgs *args) override {
@@ -56,7 +72,9 @@ namespace lspd {
         }
 
         void preServerSpecialize([[maybe_unused]] zygisk::ServerSpecializeArgs *args) override {
-            MagiskLoader::GetInstance()->OnNativeForkSystemServerPre(env_);
+            if (MagiskLoader::GetInstance()->OnNativeForkSystemServerPre(env_)) {
+                PreloadFrameworkDex();
+            }
         }
 
         void postServerSpecialize([[maybe_unused]] const zygisk::ServerSpecializeArgs *args) override {
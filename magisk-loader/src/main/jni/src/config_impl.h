@@ -29,12 +29,12 @@ namespace lspd {
             instance_ = std::make_unique<ConfigImpl>();
         }
 
-        virtual obfuscation_map_t &obfuscation_map() override { return obfuscation_map_; }
+        virtual const obfuscation_map_t &obfuscation_map() override { return obfuscation_map_; }
 
         virtual void
         obfuscation_map(obfuscation_map_t m) override { obfuscation_map_ = std::move(m); }
 
     private:
-        inline static std::map<std::string, std::string> obfuscation_map_;
+        inline static obfuscation_map_t obfuscation_map_;
     };
 }
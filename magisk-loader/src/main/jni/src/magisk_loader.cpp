@@ -21,6 +21,7 @@
 #include <fcntl.h>
 #include <linux/fs.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "config_impl.h"
 #include "elf_util.h"
@@ -28,6 +29,7 @@
 #include "magisk_loader.h"
 #include "native_util.h"
 #include "service.h"
+#include "startup_profiler.h"
 #include "symbol_cache.h"
 #include "utils/jni_helper.hpp"
 
@@ -48,7 +50,7 @@ namespace lspd {
     static constexpr uid_t kAidInjected = INJECTED_AID;
     static constexpr uid_t kAidInet = 3003;
 
-    void MagiskLoader::LoadDex(JNIEnv *env, PreloadedDex &&dex) {
+    void MagiskLoader::LoadDex(JNIEnv *env, PreloadedDex dex) {
         auto classloader = JNI_FindClass(env, "java/lang/ClassLoader");
         auto getsyscl_mid = JNI_GetStaticMethodID(
                 env, classloader, "getSystemClassLoader", "()Ljava/lang/ClassLoader;");
@@ -73,78 +75,159 @@ namespace lspd {
         env->DeleteLocalRef(dex_buffer);
     }
 
-    std::string GetEntryClassName() {
-        const auto &obfs_map = ConfigBridge::GetInstance()->obfuscation_map();
-        static auto signature = obfs_map.at("org.lsposed.lspd.core.") + "Main";
-        return signature;
+    void MagiskLoader::PreloadFrameworkDex(int dex_fd, bool in_zygote) {
+        if (dex_fd < 0) {
+            LOGD("framework dex is not accessible");
+            return;
+        }
+        struct stat st{};
+        if (fstat(dex_fd, &st) == 0 && st.st_size > 0) {
+            // Faulting the image in once in zygote leaves it in the page cache for every child
+            auto policy = PreloadedDex::DefaultMapPolicy();
+            if (in_zygote && policy != PreloadedDex::MapPolicy::kPlain) {
+                policy = PreloadedDex::MapPolicy::kPopulate;
+            }
+            zygote_dex_ = PreloadedDex(dex_fd, st.st_size, policy);
+        }
+        close(dex_fd);
+    }
+
+    void MagiskLoader::MapScopeBitmap(int bitmap_fd) {
+        if (bitmap_fd < 0) {
+            LOGD("scope bitmap is not accessible");
+            return;
+        }
+        scope_bitmap_ = ScopeBitmap(bitmap_fd);
+    }
+
+    void MagiskLoader::ReleaseScopeBitmap() {
+        // Only the skip decision needs the bitmap, a mapping kept in the child would show the
+        // module directory in /proc/self/maps for its whole life
+        scope_bitmap_ = ScopeBitmap();
+    }
+
+    MagiskLoader::PreloadedDex
+    MagiskLoader::ObtainFrameworkDex(int dex_fd, size_t size, uint32_t &profile_flags) {
+        // The daemon leaves the dex out of the bootstrap reply only when it serves the framework
+        // dex as is and we told it that the preloaded copy is still there
+        if (dex_fd < 0 && zygote_dex_) {
+            LOGD("using preloaded framework dex");
+            // whatever zygote did to map it, nothing is mapped here
+            profile_flags |= StartupProfiler::kFlagDexFromZygote;
+            return std::move(zygote_dex_);
+        }
+        // obfuscated, the preloaded copy is of no use
+        zygote_dex_ = PreloadedDex();
+        if (dex_fd < 0) return {};
+        PreloadedDex dex(dex_fd, size);
+        close(dex_fd);
+        // lets the daemon compare startups by how the framework dex was mapped
+        if (dex && dex.policy() == PreloadedDex::MapPolicy::kWillNeed) {
+            profile_flags |= StartupProfiler::kFlagDexWillNeed;
+        }
+        return dex;
+    }
+
+    // Identical for both specialization paths. Symbols come from the ArtSymbolCache, libart
+    // itself is only parsed for misses and released again once lsplant is initialized
+    static const lsplant::InitInfo &GetInitInfo() {
+        static const lsplant::InitInfo init_info{
+                .inline_hooker = [](auto t, auto r) {
+                    void* bk = nullptr;
+                    return HookFunction(t, r, &bk) == RS_SUCCESS ? bk : nullptr;
+                },
+                .inline_unhooker = [](auto t) {
+                    return UnhookFunction(t) == RT_SUCCESS;
+                },
+                .art_symbol_resolver = [](auto symbol) {
+                    return ArtSymbolCache::GetInstance().Resolve(symbol, false);
+                },
+                .art_symbol_prefix_resolver = [](auto symbol) {
+                    return ArtSymbolCache::GetInstance().Resolve(symbol, true);
+                },
+        };
+        return init_info;
+    }
+
+    std::string_view GetEntryClassName() {
+        return ConfigBridge::GetInstance()->obfuscation_map()[kEntryClass];
     }
 
     void MagiskLoader::SetupEntryClass(JNIEnv *env) {
-        if (auto entry_class = FindClassFromLoader(env, GetCurrentClassLoader(),
-                                                   GetEntryClassName())) {
+        if (auto entry_class = FindClassFromCurrentLoader(env, GetEntryClassName())) {
             entry_class_ = JNI_NewGlobalRef(env, entry_class);
         }
     }
 
-    void
+    bool
     MagiskLoader::OnNativeForkSystemServerPre(JNIEnv *env) {
         Service::instance()->InitService(env);
         setAllowUnload(skip_);
+        return !skip_;
     }
 
     void
     MagiskLoader::OnNativeForkSystemServerPost(JNIEnv *env) {
+        ReleaseScopeBitmap();
         if (!skip_) {
+            StartupProfiler profiler;
             auto *instance = Service::instance();
             auto system_server_binder = instance->RequestSystemServerBinder(env);
             if (!system_server_binder) {
                 LOGF("Failed to get system server binder, system server initialization failed.");
+                zygote_dex_ = PreloadedDex();
                 return;
             }
 
             auto application_binder = instance->RequestApplicationBinderFromSystemServer(env, system_server_binder);
+            profiler.Mark(kPhaseBinder);
 
             // Call application_binder directly if application binder is available,
             // or we proxy the request from system server binder
             auto &&next_binder = application_binder ? application_binder : system_server_binder;
-            const auto [dex_fd, size] = instance->RequestLSPDex(env, next_binder);
-            auto obfs_map = instance->RequestObfuscationMap(env, next_binder);
-            ConfigBridge::GetInstance()->obfuscation_map(std::move(obfs_map));
-            LoadDex(env, PreloadedDex(dex_fd, size));
-            close(dex_fd);
+            auto &art_symbols = ArtSymbolCache::GetInstance();
+            auto bootstrap = instance->RequestBootstrap(env, next_binder, zygote_dex_,
+                                                        art_symbols.build_id());
+            auto profile_flags = StartupProfiler::kFlagSystemServer;
+            auto dex = ObtainFrameworkDex(bootstrap.dex_fd, bootstrap.dex_size, profile_flags);
+            ConfigBridge::GetInstance()->obfuscation_map(std::move(bootstrap.obfs_map));
+            art_symbols.Load(bootstrap.art_symbols);
+            profiler.Mark(kPhaseBootstrap);
+            LoadDex(env, std::move(dex));
+            profiler.Mark(kPhaseLoadDex);
             instance->HookBridge(*this, env);
 
             if (application_binder) {
-                lsplant::InitInfo initInfo{
-                    .inline_hooker = [](auto t, auto r) {
-                        void* bk = nullptr;
-                        return HookFunction(t, r, &bk) == RS_SUCCESS ? bk : nullptr;
-                    },
-                    .inline_unhooker = [](auto t) {
-                        return UnhookFunction(t) == RT_SUCCESS ;
-                    },
-                    .art_symbol_resolver = [](auto symbol) {
-                        return GetArt()->getSymbAddress(symbol);
-                    },
-                    .art_symbol_prefix_resolver = [](auto symbol) {
-                        return GetArt()->getSymbPrefixFirstAddress(symbol);
-                    },
-                };
-                InitArtHooker(env, initInfo);
+                InitArtHooker(env, GetInitInfo());
+                profiler.Mark(kPhaseInitArtHooker);
+                // system_server starts before any app, so apps of a new libart build find the
+                // symbols resolved here
+                if (art_symbols.dirty()) {
+                    instance->SendArtSymbols(env, application_binder, art_symbols.build_id(),
+                                             art_symbols.Serialize());
+                }
                 InitHooks(env);
+                profiler.Mark(kPhaseInitHooks);
                 SetupEntryClass(env);
+                profiler.Mark(kPhaseSetupEntryClass);
                 FindAndCall(env, "forkCommon",
                             "(ZLjava/lang/String;Ljava/lang/String;Landroid/os/IBinder;)V",
                             JNI_TRUE, JNI_NewStringUTF(env, "system"), nullptr, application_binder);
+                profiler.Mark(kPhaseForkCommon);
+                instance->SendStartupRecord(env, application_binder,
+                                            profiler.Finish(profile_flags, installed_hook_count.load()));
                 GetArt(true);
             } else {
                 LOGI("skipped system server");
+                zygote_dex_ = PreloadedDex();
                 GetArt(true);
             }
+        } else {
+            zygote_dex_ = PreloadedDex();
         }
     }
 
-    void MagiskLoader::OnNativeForkAndSpecializePre(JNIEnv *env,
+    bool MagiskLoader::OnNativeForkAndSpecializePre(JNIEnv *env,
                                                jint uid,
                                                jintArray &gids,
                                                jstring nice_name,
@@ -160,67 +243,77 @@ namespace lspd {
             if (gids) env->SetIntArrayRegion(gids, 0, 1, region.get() + array_size);
             gids = new_gids;
         }
-        Service::instance()->InitService(env);
+        // Most forks are skipped, so the decision only looks at integers and pointers
         const auto app_id = uid % PER_USER_RANGE;
-        JUTFString process_name(env, nice_name);
-        skip_ = false;
-        if (!skip_ && !app_data_dir) {
-            LOGD("skip injecting into {} because it has no data dir", process_name.get());
-            skip_ = true;
+        const char *reason = nullptr;
+        if (!app_data_dir) {
+            reason = "it has no data dir";
+        } else if (is_child_zygote) {
+            reason = "it's a child zygote";
+        } else if ((app_id >= FIRST_ISOLATED_UID && app_id <= LAST_ISOLATED_UID) ||
+                   (app_id >= FIRST_APP_ZYGOTE_ISOLATED_UID &&
+                    app_id <= LAST_APP_ZYGOTE_ISOLATED_UID) ||
+                   app_id == SHARED_RELRO_UID) {
+            reason = "it's isolated";
+        } else if (!scope_bitmap_.MayInject(app_id)) {
+            reason = "it's not in scope";
         }
-        if (!skip_ && is_child_zygote) {
-            skip_ = true;
-            LOGD("skip injecting into {} because it's a child zygote", process_name.get());
-        }
-
-        if (!skip_ && ((app_id >= FIRST_ISOLATED_UID && app_id <= LAST_ISOLATED_UID) ||
-                       (app_id >= FIRST_APP_ZYGOTE_ISOLATED_UID &&
-                        app_id <= LAST_APP_ZYGOTE_ISOLATED_UID) ||
-                       app_id == SHARED_RELRO_UID)) {
-            skip_ = true;
-            LOGI("skip injecting into {} because it's isolated", process_name.get());
+        skip_ = reason != nullptr;
+        if (skip_) {
+            if constexpr (isDebug) {
+                JUTFString process_name(env, nice_name);
+                LOGD("skip injecting into {} because {}", process_name.get(), reason);
+            }
+        } else {
+            Service::instance()->InitService(env);
         }
         setAllowUnload(skip_);
+        return !skip_;
     }
 
     void
     MagiskLoader::OnNativeForkAndSpecializePost(JNIEnv *env, jstring nice_name, jstring app_dir) {
+        ReleaseScopeBitmap();
+        if (skip_) {
+            // Nothing was set up for this process, the library is unloaded right after
+            zygote_dex_ = PreloadedDex();
+            setAllowUnload(true);
+            return;
+        }
         const JUTFString process_name(env, nice_name);
+        StartupProfiler profiler;
         auto *instance = Service::instance();
-        auto binder = skip_ ? ScopedLocalRef<jobject>{env, nullptr}
-                            : instance->RequestBinder(env, nice_name);
+        auto binder = instance->RequestBinder(env, nice_name);
         if (binder) {
-            lsplant::InitInfo initInfo{
-                    .inline_hooker = [](auto t, auto r) {
-                        void* bk = nullptr;
-                        return HookFunction(t, r, &bk) == RS_SUCCESS ? bk : nullptr;
-                    },
-                    .inline_unhooker = [](auto t) {
-                        return UnhookFunction(t) == RT_SUCCESS;
-                    },
-                    .art_symbol_resolver = [](auto symbol){
-                        return GetArt()->getSymbAddress(symbol);
-                    },
-                    .art_symbol_prefix_resolver = [](auto symbol) {
-                        return GetArt()->getSymbPrefixFirstAddress(symbol);
-                    },
-            };
-            auto [dex_fd, size] = instance->RequestLSPDex(env, binder);
-            auto obfs_map = instance->RequestObfuscationMap(env, binder);
-            ConfigBridge::GetInstance()->obfuscation_map(std::move(obfs_map));
-            LoadDex(env, PreloadedDex(dex_fd, size));
-            close(dex_fd);
-            InitArtHooker(env, initInfo);
+            profiler.Mark(kPhaseBinder);
+            auto &art_symbols = ArtSymbolCache::GetInstance();
+            auto bootstrap = instance->RequestBootstrap(env, binder, zygote_dex_,
+                                                        art_symbols.build_id());
+            uint32_t profile_flags = 0;
+            auto dex = ObtainFrameworkDex(bootstrap.dex_fd, bootstrap.dex_size, profile_flags);
+            ConfigBridge::GetInstance()->obfuscation_map(std::move(bootstrap.obfs_map));
+            art_symbols.Load(bootstrap.art_symbols);
+            profiler.Mark(kPhaseBootstrap);
+            LoadDex(env, std::move(dex));
+            profiler.Mark(kPhaseLoadDex);
+            InitArtHooker(env, GetInitInfo());
+            profiler.Mark(kPhaseInitArtHooker);
             InitHooks(env);
+            profiler.Mark(kPhaseInitHooks);
             SetupEntryClass(env);
+            profiler.Mark(kPhaseSetupEntryClass);
             LOGD("Done prepare");
             FindAndCall(env, "forkCommon",
                         "(ZLjava/lang/String;Ljava/lang/String;Landroid/os/IBinder;)V",
                         JNI_FALSE, nice_name, app_dir, binder);
+            profiler.Mark(kPhaseForkCommon);
+            instance->SendStartupRecord(env, binder,
+                                        profiler.Finish(profile_flags, installed_hook_count.load()));
             LOGD("injected xposed into {}", process_name.get());
             setAllowUnload(false);
             GetArt(true);
         } else {
+            instance->ReleaseHeartBeat(env);
             auto context = Context::ReleaseInstance();
             auto service = Service::ReleaseInstance();
             GetArt(true);
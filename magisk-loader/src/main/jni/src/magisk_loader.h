@@ -23,7 +23,9 @@
 
 #pragma once
 
+#include "config_bridge.h"
 #include "context.h"
+#include "scope_bitmap.h"
 
 namespace lspd {
     class MagiskLoader : public Context {
@@ -36,22 +38,40 @@ namespace lspd {
             return static_cast<MagiskLoader*>(instance_.get());
         }
 
-        void OnNativeForkAndSpecializePre(JNIEnv *env, jint uid, jintArray &gids, jstring nice_name,
+        // Returns whether the process is going to be injected
+        bool OnNativeForkAndSpecializePre(JNIEnv *env, jint uid, jintArray &gids, jstring nice_name,
                                           jboolean is_child_zygote, jstring app_data_dir);
 
         void OnNativeForkAndSpecializePost(JNIEnv *env, jstring nice_name, jstring app_dir);
 
         void OnNativeForkSystemServerPost(JNIEnv *env);
 
-        void OnNativeForkSystemServerPre(JNIEnv *env);
+        // Returns whether the process is going to be injected
+        bool OnNativeForkSystemServerPre(JNIEnv *env);
+
+        // Takes the ownership of dex_fd. In zygote the image is faulted in once for every child,
+        // otherwise it is mapped as the daemon's copy would be.
+        void PreloadFrameworkDex(int dex_fd, bool in_zygote);
+
+        void MapScopeBitmap(int bitmap_fd);
+
+        // Unmaps the bitmap of a process that made its skip decision, never call it in zygote
+        void ReleaseScopeBitmap();
 
     protected:
-        void LoadDex(JNIEnv *env, PreloadedDex &&dex) override;
+        void LoadDex(JNIEnv *env, PreloadedDex dex) override;
 
         void SetupEntryClass(JNIEnv *env) override;
 
     private:
         bool skip_ = false;
+        // mapped when the daemon served the framework dex as is at its last start, in zygote for
+        // Riru and in the pre hook of injected children for Zygisk. Children either load it or
+        // unmap it right after bootstrap
+        PreloadedDex zygote_dex_;
+        ScopeBitmap scope_bitmap_;
+
+        PreloadedDex ObtainFrameworkDex(int dex_fd, size_t size, uint32_t &profile_flags);
 
         static void setAllowUnload(bool unload);
     };
@@ -0,0 +1,88 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2022 LSPosed Contributors
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "logging.h"
+#include "scope_bitmap.h"
+
+namespace lspd {
+    namespace {
+        constexpr uint32_t kBitmapMagic = 0x4250534c;  // "LSPB"
+        constexpr uint32_t kBitmapVersion = 1;
+
+        struct BitmapHeader {
+            uint32_t magic;
+            uint32_t version;
+            // 0 before the first update, odd while the daemon is writing
+            uint32_t generation;
+            // number of app ids covered by the bitmap
+            uint32_t bits;
+        };
+        static_assert(sizeof(BitmapHeader) == 16);
+    }
+
+    ScopeBitmap::ScopeBitmap(int fd) {
+        if (fd < 0) return;
+        struct stat s{};
+        if (fstat(fd, &s) == 0 && static_cast<size_t>(s.st_size) > sizeof(BitmapHeader)) {
+            size_ = s.st_size;
+            addr_ = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+            if (addr_ == MAP_FAILED) {
+                PLOGE("map scope bitmap");
+                addr_ = nullptr;
+                size_ = 0;
+            }
+        }
+        close(fd);
+    }
+
+    ScopeBitmap &ScopeBitmap::operator=(ScopeBitmap &&other) noexcept {
+        if (this != &other) {
+            if (addr_) munmap(addr_, size_);
+            addr_ = other.addr_;
+            size_ = other.size_;
+            other.addr_ = nullptr;
+            other.size_ = 0;
+        }
+        return *this;
+    }
+
+    ScopeBitmap::~ScopeBitmap() {
+        if (addr_) munmap(addr_, size_);
+    }
+
+    bool ScopeBitmap::MayInject(uint32_t app_id) const {
+        if (!addr_) return true;
+        auto *header = static_cast<BitmapHeader *>(addr_);
+        auto generation = __atomic_load_n(&header->generation, __ATOMIC_ACQUIRE);
+        if (generation == 0 || (generation & 1) || header->magic != kBitmapMagic ||
+            header->version != kBitmapVersion || app_id >= header->bits ||
+            sizeof(BitmapHeader) + (header->bits + 7) / 8 > size_) {
+            return true;
+        }
+        auto *bits = reinterpret_cast<const uint8_t *>(header + 1);
+        bool set = bits[app_id / 8] & (1u << (app_id % 8));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        // the daemon updated the bitmap while we were reading
+        return set || __atomic_load_n(&header->generation, __ATOMIC_RELAXED) != generation;
+    }
+}
@@ -0,0 +1,59 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2022 LSPosed Contributors
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace lspd {
+    // Read-only view of the scope bitmap the daemon keeps in the module directory, with one bit
+    // per app id that may be injected. Riru maps it shared once in zygote and every child inherits
+    // the mapping, Zygisk maps it in the pre hook of every forked app. Either way the skip
+    // decision sees the daemon's latest update without any IPC, and the mapping is dropped right
+    // after it. Layout must match ScopeBitmap.java.
+    class ScopeBitmap {
+    public:
+        ScopeBitmap() = default;
+
+        // Takes the ownership of fd
+        explicit ScopeBitmap(int fd);
+
+        ScopeBitmap(ScopeBitmap &&other) noexcept: addr_(other.addr_), size_(other.size_) {
+            other.addr_ = nullptr;
+            other.size_ = 0;
+        }
+
+        ScopeBitmap &operator=(ScopeBitmap &&other) noexcept;
+
+        ScopeBitmap(const ScopeBitmap &) = delete;
+
+        ScopeBitmap &operator=(const ScopeBitmap &) = delete;
+
+        ~ScopeBitmap();
+
+        // Conservative: only false when the daemon has published a complete bitmap
+        // and app_id is not in it
+        bool MayInject(uint32_t app_id) const;
+
+    private:
+        void *addr_ = nullptr;
+        size_t size_ = 0;
+    };
+}
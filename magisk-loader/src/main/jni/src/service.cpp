@@ -22,7 +22,13 @@
 //
 
 #include <dobby.h>
+#include <algorithm>
 #include <thread>
+#include <chrono>
+#include <dlfcn.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <linux/android/binder.h>
 #include "loader.h"
 #include "service.h"
 #include "context.h"
@@ -30,48 +36,76 @@
 #include "symbol_cache.h"
 #include "config_bridge.h"
 #include "elf_util.h"
+#include "native_util.h"
 
 using namespace lsplant;
 
 namespace lspd {
     std::unique_ptr<Service> Service::instance_ = std::make_unique<Service>();
 
+    void Service::RegisterTransactionHandler(jint code, NativeTransactionHandler handler,
+                                             TransactionDisposition disposition) {
+        AddTransactionHandler({code, handler, nullptr, disposition});
+    }
+
+    void Service::RegisterTransactionHandler(jint code, jmethodID bridge_method,
+                                             TransactionDisposition disposition) {
+        AddTransactionHandler({code, nullptr, bridge_method, disposition});
+    }
+
+    void Service::AddTransactionHandler(TransactionHandler handler) {
+        if (transact_hooked_) {
+            LOGE("transaction handler for {} registered after hooking", handler.code);
+            return;
+        }
+        if (!handler.native && !handler.java) return;
+        auto it = std::lower_bound(transaction_handlers_.begin(), transaction_handlers_.end(),
+                                   handler.code,
+                                   [](const auto &h, jint code) { return h.code < code; });
+        if (it != transaction_handlers_.end() && it->code == handler.code) {
+            LOGW("replacing transaction handler for {}", handler.code);
+            *it = handler;
+        } else {
+            transaction_handlers_.insert(it, handler);
+        }
+    }
+
+    const Service::TransactionHandler *Service::FindTransactionHandler(jint code) const {
+        auto it = std::lower_bound(transaction_handlers_.begin(), transaction_handlers_.end(),
+                                   code,
+                                   [](const auto &h, jint code) { return h.code < code; });
+        if (it == transaction_handlers_.end() || it->code != code) [[likely]] return nullptr;
+        return &*it;
+    }
+
     jboolean
-    Service::exec_transact_replace(jboolean *res, JNIEnv *env, [[maybe_unused]] jobject obj,
-                                   va_list args) {
-        va_list copy;
-        va_copy(copy, args);
-        auto code = va_arg(copy, jint);
-        auto data_obj = va_arg(copy, jlong);
-        auto reply_obj = va_arg(copy, jlong);
-        auto flags = va_arg(copy, jint);
-        va_end(copy);
-
-        if (code == BRIDGE_TRANSACTION_CODE) [[unlikely]] {
-            *res = JNI_CallStaticBooleanMethod(env, instance()->bridge_service_class_,
-                                               instance()->exec_transact_replace_methodID_,
-                                               obj, code, data_obj, reply_obj, flags);
-            return true;
-        } else if (SET_ACTIVITY_CONTROLLER_CODE != -1 &&
-                   code == SET_ACTIVITY_CONTROLLER_CODE) [[unlikely]] {
-            va_copy(copy, args);
-            if (instance()->replace_activity_controller_methodID_) {
-                *res = JNI_CallStaticBooleanMethod(env, instance()->bridge_service_class_,
-                                                   instance()->replace_activity_controller_methodID_,
-                                                   obj, code, data_obj, reply_obj, flags);
-            }
-            va_end(copy);
-            // fallback the backup
-        } else if (code == (('_' << 24) | ('C' << 16) | ('M' << 8) | 'D')) {
-            va_copy(copy, args);
-            if (instance()->replace_shell_command_methodID_) {
-                *res = JNI_CallStaticBooleanMethod(env, instance()->bridge_service_class_,
-                                                   instance()->replace_shell_command_methodID_,
-                                                   obj, code, data_obj, reply_obj, flags);
-            }
-            va_end(copy);
-            return *res;
+    Service::exec_transact_replace(const TransactionHandler &handler, jboolean *res, JNIEnv *env,
+                                   jobject obj, jint code, jlong data_obj, jlong reply_obj,
+                                   jint flags) {
+        jboolean handled = handler.native ?
+                           handler.native(env, obj, code, data_obj, reply_obj, flags) :
+                           JNI_CallStaticBooleanMethod(env, instance()->bridge_service_class_,
+                                                       handler.java, obj, code, data_obj,
+                                                       reply_obj, flags);
+        switch (handler.disposition) {
+            case TransactionDisposition::kConsume:
+                *res = handled;
+                return true;
+            case TransactionDisposition::kConsumeIfHandled:
+                *res = handled;
+                if (handled) return true;
+                break;
+            case TransactionDisposition::kPassThrough:
+            default:
+                break;
+        }
+        // The original transaction runs next and must not see an exception of the handler
+        if (env->ExceptionCheck()) [[unlikely]] {
+            LOGE("uncaught exception in handler of transaction {}", code);
+            env->ExceptionDescribe();
+            env->ExceptionClear();
         }
+        // fallback the backup
         return false;
     }
 
@@ -79,13 +113,107 @@ namespace lspd {
     Service::call_boolean_method_va_replace(JNIEnv *env, jobject obj, jmethodID methodId,
                                             va_list args) {
         if (methodId == instance()->exec_transact_backup_methodID_) [[unlikely]] {
+            va_list copy;
+            va_copy(copy, args);
+            auto code = va_arg(copy, jint);
+            auto data_obj = va_arg(copy, jlong);
+            auto reply_obj = va_arg(copy, jlong);
+            auto flags = va_arg(copy, jint);
+            va_end(copy);
             jboolean res = false;
-            if (exec_transact_replace(&res, env, obj, args)) [[unlikely]] return res;
+            if (auto *handler = instance()->FindTransactionHandler(code);
+                handler && exec_transact_replace(*handler, &res, env, obj, code, data_obj,
+                                                 reply_obj, flags)) [[unlikely]]
+                return res;
             // else fallback to backup
         }
         return instance()->call_boolean_method_va_backup_(env, obj, methodId, args);
     }
 
+    bool Service::ResolveJavaBinderObjectOffset(JNIEnv *env) {
+        // JavaBBinder keeps `JavaVM *mVM` right before `jobject mObject` (the global ref to the
+        // Java Binder), after the fields of BBinder whose size differs between releases. A
+        // JavaBBinder only exists once its Binder is flattened, so flatten one of ours and find
+        // the field in the JavaBBinder that the parcel refers to.
+        constexpr size_t kMaxProbe = 32;
+        auto *native_data = parcel_natives_.data;
+        if (!native_data || !binder_ctor_) return false;
+        auto binder = JNI_NewObject(env, binder_class_, binder_ctor_);
+        auto parcel = JNI_CallStaticObjectMethod(env, parcel_class_, obtain_method_);
+        if (!binder || !parcel) return false;
+        JNI_CallVoidMethod(env, parcel, write_strong_binder_method_, binder);
+        size_t offset = 0;
+        auto *native = GetNativeParcel(env, parcel.get());
+        if (native && JNI_CallIntMethod(env, parcel, data_size_method_) >=
+                      static_cast<jint>(sizeof(flat_binder_object))) {
+            auto *object = reinterpret_cast<const flat_binder_object *>(native_data(native));
+            if (object->hdr.type == BINDER_TYPE_BINDER && object->cookie) {
+                auto *words = reinterpret_cast<void *const *>(static_cast<uintptr_t>(object->cookie));
+                for (size_t i = 1; i + 1 < kMaxProbe; ++i) {
+                    if (words[i] != java_vm_) continue;
+                    if (words[i + 1] && env->IsSameObject(static_cast<jobject>(words[i + 1]), binder.get()))
+                        offset = i + 1;
+                    break;
+                }
+            }
+        }
+        JNI_CallVoidMethod(env, parcel, recycleMethod_);
+        if (offset == 0) {
+            LOGW("JavaBBinder::mObject not found");
+            return false;
+        }
+        java_binder_object_offset_ = offset;
+        return true;
+    }
+
+    int32_t Service::java_bbinder_on_transact_replace(void *thiz, uint32_t code,
+                                                      const void *data, void *reply,
+                                                      uint32_t flags) {
+        auto *service = instance();
+        auto icode = static_cast<jint>(code);
+        auto *handler = service->FindTransactionHandler(icode);
+        if (!handler) [[likely]] {
+            return service->java_bbinder_on_transact_backup_(thiz, code, data, reply, flags);
+        }
+        JNIEnv *env = nullptr;
+        jobject obj = service->GetJavaBinderObject(thiz);
+        if (service->java_vm_->GetEnv(reinterpret_cast<void **>(&env), JNI_VERSION_1_6) != JNI_OK ||
+            !obj) [[unlikely]] {
+            return service->java_bbinder_on_transact_backup_(thiz, code, data, reply, flags);
+        }
+        jboolean res = false;
+        if (exec_transact_replace(*handler, &res, env, obj, icode, reinterpret_cast<jlong>(data),
+                                  reinterpret_cast<jlong>(reply), static_cast<jint>(flags))) {
+            // same handling as JavaBBinder does for Binder.execTransact
+            if (env->ExceptionCheck()) [[unlikely]] {
+                LOGE("uncaught exception in bridge transaction {}", code);
+                env->ExceptionDescribe();
+                env->ExceptionClear();
+                return STATUS_UNKNOWN_TRANSACTION;
+            }
+            return res ? STATUS_OK : STATUS_UNKNOWN_TRANSACTION;
+        }
+        return service->java_bbinder_on_transact_backup_(thiz, code, data, reply, flags);
+    }
+
+    bool Service::HookJavaBBinder(JNIEnv *env) {
+        auto *on_transact = SandHook::ElfImg("/libandroid_runtime.so").getSymbAddress(
+                "_ZN7android11JavaBBinder10onTransactEjRKNS_6ParcelEPS1_j");
+        if (!on_transact) {
+            LOGW("JavaBBinder::onTransact not found");
+            return false;
+        }
+        if (env->GetJavaVM(&java_vm_) != JNI_OK || !ResolveJavaBinderObjectOffset(env)) return false;
+        void *backup = nullptr;
+        if (HookFunction(on_transact, reinterpret_cast<void *>(&java_bbinder_on_transact_replace),
+                         &backup) != RS_SUCCESS || !backup) {
+            LOGE("failed to hook JavaBBinder::onTransact");
+            return false;
+        }
+        java_bbinder_on_transact_backup_ = reinterpret_cast<decltype(java_bbinder_on_transact_backup_)>(backup);
+        return true;
+    }
+
     void Service::InitService(JNIEnv *env) {
         if (initialized_) [[unlikely]] return;
 
@@ -124,14 +252,15 @@ namespace lspd {
         write_strong_binder_method_ = JNI_GetMethodID(env, parcel_class_, "writeStrongBinder",
                                                       "(Landroid/os/IBinder;)V");
         read_exception_method_ = JNI_GetMethodID(env, parcel_class_, "readException", "()V");
-        read_int_method_ = JNI_GetMethodID(env, parcel_class_, "readInt", "()I");
         read_long_method_ = JNI_GetMethodID(env, parcel_class_, "readLong", "()J");
         read_strong_binder_method_ = JNI_GetMethodID(env, parcel_class_, "readStrongBinder",
                                                      "()Landroid/os/IBinder;");
-        read_string_method_ = JNI_GetMethodID(env, parcel_class_, "readString",
-                                                     "()Ljava/lang/String;");
         read_file_descriptor_method_ = JNI_GetMethodID(env, parcel_class_, "readFileDescriptor",
                                                        "()Landroid/os/ParcelFileDescriptor;");
+        set_data_position_method_ = JNI_GetMethodID(env, parcel_class_, "setDataPosition", "(I)V");
+        write_byte_array_method_ = JNI_GetMethodID(env, parcel_class_, "writeByteArray", "([B)V");
+        create_byte_array_method_ = JNI_GetMethodID(env, parcel_class_, "createByteArray", "()[B");
+        InitParcelNatives(env);
 //        createStringArray_ = env->GetMethodID(parcel_class_, "createStringArray",
 //                                              "()[Ljava/lang/String;");
 
@@ -150,10 +279,8 @@ namespace lspd {
         initialized_ = true;
     }
 
-    std::string GetBridgeServiceName() {
-        const auto &obfs_map = ConfigBridge::GetInstance()->obfuscation_map();
-        static auto signature = obfs_map.at("org.lsposed.lspd.service.") + "BridgeService";
-        return signature;
+    std::string_view GetBridgeServiceName() {
+        return ConfigBridge::GetInstance()->obfuscation_map()[kBridgeServiceClass];
     }
 
     void Service::HookBridge(const Context &context, JNIEnv *env) {
@@ -172,28 +299,51 @@ namespace lspd {
 
         constexpr const auto *hooker_sig = "(Landroid/os/IBinder;IJJI)Z";
 
-        exec_transact_replace_methodID_ = JNI_GetStaticMethodID(env, bridge_service_class_,
-                                                                "execTransact",
-                                                                hooker_sig);
-        if (!exec_transact_replace_methodID_) {
+        if (auto *exec_transact = JNI_GetStaticMethodID(env, bridge_service_class_,
+                                                        "execTransact", hooker_sig)) {
+            RegisterTransactionHandler(BRIDGE_TRANSACTION_CODE, exec_transact,
+                                       TransactionDisposition::kConsume);
+        } else {
             LOGE("execTransact class not found");
             return;
         }
 
-
-        replace_activity_controller_methodID_ = JNI_GetStaticMethodID(env, bridge_service_class_,
-                                                                      "replaceActivityController",
-                                                                      hooker_sig);
-        if (!replace_activity_controller_methodID_) {
+        jint set_activity_controller_code = -1;
+        if (auto activity_thread_class = JNI_FindClass(env, "android/app/IActivityManager$Stub")) {
+            if (auto *set_activity_controller_field = JNI_GetStaticFieldID(env,
+                                                                           activity_thread_class,
+                                                                           "TRANSACTION_setActivityController",
+                                                                           "I")) {
+                set_activity_controller_code = JNI_GetStaticIntField(env, activity_thread_class,
+                                                                     set_activity_controller_field);
+            }
+        }
+        if (auto *replace_activity_controller = JNI_GetStaticMethodID(
+                env, bridge_service_class_, "replaceActivityController", hooker_sig)) {
+            // only swaps the controller argument, activity manager still handles the call
+            if (set_activity_controller_code != -1)
+                RegisterTransactionHandler(set_activity_controller_code,
+                                           replace_activity_controller,
+                                           TransactionDisposition::kPassThrough);
+        } else {
             LOGE("replaceActivityShell class not found");
         }
 
-        replace_shell_command_methodID_ = JNI_GetStaticMethodID(env, bridge_service_class_,
-                                                                "replaceShellCommand",
-                                                                hooker_sig);
-        if (!replace_shell_command_methodID_) {
+        if (auto *replace_shell_command = JNI_GetStaticMethodID(
+                env, bridge_service_class_, "replaceShellCommand", hooker_sig)) {
+            RegisterTransactionHandler(SHELL_COMMAND_TRANSACTION_CODE, replace_shell_command,
+                                       TransactionDisposition::kConsumeIfHandled);
+        } else {
             LOGE("replaceShellCommand class not found");
         }
+        transact_hooked_ = true;
+
+        // Hooking JavaBBinder::onTransact only costs other transactions a code check, while
+        // the JNI table override is hit by every CallBooleanMethodV of the process.
+        if (HookJavaBBinder(env)) {
+            LOGD("Done InitService");
+            return;
+        }
 
         auto binder_class = JNI_FindClass(env, "android/os/Binder");
         exec_transact_backup_methodID_ = JNI_GetMethodID(env, binder_class, "execTransact",
@@ -211,17 +361,126 @@ namespace lspd {
         if (setTableOverride != nullptr) {
             setTableOverride(&native_interface_replace_);
         }
-        if (auto activity_thread_class = JNI_FindClass(env, "android/app/IActivityManager$Stub")) {
-            if (auto *set_activity_controller_field = JNI_GetStaticFieldID(env,
-                                                                           activity_thread_class,
-                                                                           "TRANSACTION_setActivityController",
-                                                                           "I")) {
-                SET_ACTIVITY_CONTROLLER_CODE = JNI_GetStaticIntField(env, activity_thread_class,
-                                                                     set_activity_controller_field);
+        LOGD("Done InitService");
+    }
+
+    void Service::InitParcelNatives(JNIEnv *env) {
+        parcel_natives_.native_ptr = JNI_GetFieldID(env, parcel_class_, "mNativePtr", "J");
+        if (!parcel_natives_.native_ptr) {
+            LOGW("Parcel.mNativePtr not found, marshalling through Java");
+            return;
+        }
+        // All of them are exported, and libbinder is always loaded by the runtime already
+        auto *binder = dlopen("libbinder.so", RTLD_NOW | RTLD_NOLOAD);
+        if (!binder) {
+            LOGW("libbinder not loaded, marshalling through Java");
+            return;
+        }
+        auto &natives = parcel_natives_;
+        auto lookup = [binder]<typename T>(T &func, const char *symbol) {
+            func = reinterpret_cast<T>(dlsym(binder, symbol));
+        };
+        // writeInterfaceToken(const char16_t*, size_t) only exists since Android 12
+        lookup(natives.write_interface_token,
+               LP_SELECT("_ZN7android6Parcel19writeInterfaceTokenEPKDsj",
+                         "_ZN7android6Parcel19writeInterfaceTokenEPKDsm"));
+        lookup(natives.write_int32, "_ZN7android6Parcel10writeInt32Ei");
+        lookup(natives.write_string16,
+               LP_SELECT("_ZN7android6Parcel13writeString16EPKDsj",
+                         "_ZN7android6Parcel13writeString16EPKDsm"));
+        lookup(natives.read_int32, "_ZNK7android6Parcel9readInt32Ev");
+        lookup(natives.read_int64, "_ZNK7android6Parcel9readInt64Ev");
+        lookup(natives.read_file_descriptor, "_ZNK7android6Parcel18readFileDescriptorEv");
+        lookup(natives.data, "_ZNK7android6Parcel4dataEv");
+        // only drops the reference taken above
+        dlclose(binder);
+        LOGD("parcel natives: token={} int32={} string16={} read_int32={} read_int64={} read_fd={}",
+             (void *) natives.write_interface_token, (void *) natives.write_int32,
+             (void *) natives.write_string16, (void *) natives.read_int32,
+             (void *) natives.read_int64, (void *) natives.read_file_descriptor);
+    }
+
+    void *Service::GetNativeParcel(JNIEnv *env, jobject parcel) const {
+        if (!parcel_natives_.native_ptr || !parcel) return nullptr;
+        return reinterpret_cast<void *>(env->GetLongField(parcel, parcel_natives_.native_ptr));
+    }
+
+    void Service::WriteInterfaceToken(JNIEnv *env, jobject parcel) {
+        if (auto *native = GetNativeParcel(env, parcel); native && parcel_natives_.write_interface_token) {
+            parcel_natives_.write_interface_token(native, BRIDGE_SERVICE_DESCRIPTOR16.data(),
+                                                  BRIDGE_SERVICE_DESCRIPTOR16.size());
+            return;
+        }
+        auto descriptor = JNI_NewStringUTF(env, BRIDGE_SERVICE_DESCRIPTOR.data());
+        JNI_CallVoidMethod(env, parcel, write_interface_token_method_, descriptor);
+    }
+
+    void Service::WriteInt(JNIEnv *env, jobject parcel, jint val) {
+        if (auto *native = GetNativeParcel(env, parcel); native && parcel_natives_.write_int32) {
+            parcel_natives_.write_int32(native, val);
+            return;
+        }
+        JNI_CallVoidMethod(env, parcel, write_int_method_, val);
+    }
+
+    void Service::WriteString(JNIEnv *env, jobject parcel, jstring val) {
+        if (auto *native = GetNativeParcel(env, parcel); native && parcel_natives_.write_string16) {
+            if (!val) {
+                parcel_natives_.write_string16(native, nullptr, 0);
+                return;
+            }
+            auto len = env->GetStringLength(val);
+            const auto *chars = env->GetStringCritical(val, nullptr);
+            if (chars) {
+                parcel_natives_.write_string16(native, reinterpret_cast<const char16_t *>(chars),
+                                               len);
+                env->ReleaseStringCritical(val, chars);
+                return;
             }
         }
+        JNI_CallVoidMethod(env, parcel, write_string_method_, val);
+    }
 
-        LOGD("Done InitService");
+    void Service::ReadException(JNIEnv *env, jobject reply) {
+        if (auto *native = GetNativeParcel(env, reply); native && parcel_natives_.read_int32) {
+            if (parcel_natives_.read_int32(native) == 0) return;
+            // reply headers and exceptions are left to Java, the header starts the reply
+            JNI_CallVoidMethod(env, reply, set_data_position_method_, 0);
+        }
+        JNI_CallVoidMethod(env, reply, read_exception_method_);
+    }
+
+    jlong Service::ReadLong(JNIEnv *env, jobject reply) {
+        if (auto *native = GetNativeParcel(env, reply); native && parcel_natives_.read_int64) {
+            return parcel_natives_.read_int64(native);
+        }
+        return JNI_CallLongMethod(env, reply, read_long_method_);
+    }
+
+    int Service::ReadFileDescriptor(JNIEnv *env, jobject reply) {
+        if (auto *native = GetNativeParcel(env, reply); native && parcel_natives_.read_file_descriptor) {
+            // owned by the parcel, dup it like Parcel.readFileDescriptor does
+            auto fd = parcel_natives_.read_file_descriptor(native);
+            return fd >= 0 ? fcntl(fd, F_DUPFD_CLOEXEC, 0) : -1;
+        }
+        auto parcel_fd = JNI_CallObjectMethod(env, reply, read_file_descriptor_method_);
+        return parcel_fd ? JNI_CallIntMethod(env, parcel_fd, detach_fd_method_) : -1;
+    }
+
+    jobject Service::GetHeartBeatBinder(JNIEnv *env) {
+        if (!heart_beat_binder_) {
+            if (auto binder = JNI_NewObject(env, binder_class_, binder_ctor_)) {
+                heart_beat_binder_ = env->NewGlobalRef(binder.get());
+            }
+        }
+        return heart_beat_binder_;
+    }
+
+    void Service::ReleaseHeartBeat(JNIEnv *env) {
+        if (heart_beat_binder_) {
+            env->DeleteGlobalRef(heart_beat_binder_);
+            heart_beat_binder_ = nullptr;
+        }
     }
 
     ScopedLocalRef<jobject> Service::RequestBinder(JNIEnv *env, jstring nice_name) {
@@ -238,15 +497,14 @@ namespace lspd {
             return {env, nullptr};
         }
 
-        auto heart_beat_binder = JNI_NewObject(env, binder_class_, binder_ctor_);
+        auto *heart_beat_binder = GetHeartBeatBinder(env);
 
         auto data = JNI_CallStaticObjectMethod(env, parcel_class_, obtain_method_);
         auto reply = JNI_CallStaticObjectMethod(env, parcel_class_, obtain_method_);
 
-        auto descriptor = JNI_NewStringUTF(env, BRIDGE_SERVICE_DESCRIPTOR.data());
-        JNI_CallVoidMethod(env, data, write_interface_token_method_, descriptor);
-        JNI_CallVoidMethod(env, data, write_int_method_, BRIDGE_ACTION_GET_BINDER);
-        JNI_CallVoidMethod(env, data, write_string_method_, nice_name);
+        WriteInterfaceToken(env, data.get());
+        WriteInt(env, data.get(), BRIDGE_ACTION_GET_BINDER);
+        WriteString(env, data.get(), nice_name);
         JNI_CallVoidMethod(env, data, write_strong_binder_method_, heart_beat_binder);
 
         auto res = JNI_CallBooleanMethod(env, bridge_service, transact_method_,
@@ -256,14 +514,11 @@ namespace lspd {
 
         ScopedLocalRef<jobject> service = {env, nullptr};
         if (res) {
-            JNI_CallVoidMethod(env, reply, read_exception_method_);
+            ReadException(env, reply.get());
             service = JNI_CallObjectMethod(env, reply, read_strong_binder_method_);
         }
         JNI_CallVoidMethod(env, data, recycleMethod_);
         JNI_CallVoidMethod(env, reply, recycleMethod_);
-        if (service) {
-            JNI_NewGlobalRef(env, heart_beat_binder);
-        }
 
         return service;
     }
@@ -273,95 +528,127 @@ namespace lspd {
             LOGE("Service not initialized");
             return {env, nullptr};
         }
+        using namespace std::chrono_literals;
+        constexpr auto kTimeout = 3s;
         // Get Binder for LSPSystemServerService.
         // The binder itself was inject into system service "serial"
         auto bridge_service_name = JNI_NewStringUTF(env, SYSTEM_SERVER_BRIDGE_SERVICE_NAME);
-        ScopedLocalRef<jobject> binder{env, nullptr};
-        for (int i = 0; i < 3; ++i) {
-            binder = JNI_CallStaticObjectMethod(env, service_manager_class_,
-                                                get_service_method_, bridge_service_name);
-            if (binder) {
-                LOGD("Got binder for system server");
-                break;
+        auto binder = JNI_CallStaticObjectMethod(env, service_manager_class_,
+                                                 get_service_method_, bridge_service_name);
+        if (!binder) {
+            // Registration notifications from servicemanager need our binder thread pool, which
+            // is only started after the fork hooks, so poll with a growing interval instead
+            LOGI("Binder for system server not registered yet, waiting for it");
+            auto deadline = std::chrono::steady_clock::now() + kTimeout;
+            for (auto delay = 10ms; !binder && std::chrono::steady_clock::now() < deadline;
+                 delay = std::min(delay * 2, std::chrono::milliseconds(500))) {
+                std::this_thread::sleep_for(delay);
+                binder = JNI_CallStaticObjectMethod(env, service_manager_class_,
+                                                    get_service_method_, bridge_service_name);
             }
-            LOGI("Fail to get binder for system server, try again in 1s");
-            using namespace std::chrono_literals;
-            std::this_thread::sleep_for(1s);
         }
         if (!binder) {
             LOGW("Fail to get binder for system server");
             return {env, nullptr};
         }
+        LOGD("Got binder for system server");
         return binder;
     }
 
     ScopedLocalRef<jobject> Service::RequestApplicationBinderFromSystemServer(JNIEnv *env, const ScopedLocalRef<jobject> &system_server_binder) {
-        auto heart_beat_binder = JNI_NewObject(env, binder_class_, binder_ctor_);
+        auto *heart_beat_binder = GetHeartBeatBinder(env);
         Wrapper wrapper{env, this};
 
-        JNI_CallVoidMethod(env, wrapper.data, write_int_method_, getuid());
-        JNI_CallVoidMethod(env, wrapper.data, write_int_method_, getpid());
-        JNI_CallVoidMethod(env, wrapper.data, write_string_method_, JNI_NewStringUTF(env, "system"));
+        WriteInt(env, wrapper.data.get(), getuid());
+        WriteInt(env, wrapper.data.get(), getpid());
+        WriteString(env, wrapper.data.get(), JNI_NewStringUTF(env, "system").get());
         JNI_CallVoidMethod(env, wrapper.data, write_strong_binder_method_, heart_beat_binder);
 
         auto res = wrapper.transact(system_server_binder, BRIDGE_TRANSACTION_CODE);
 
         ScopedLocalRef<jobject> app_binder = {env, nullptr};
         if (res) {
-            JNI_CallVoidMethod(env, wrapper.reply, read_exception_method_);
+            ReadException(env, wrapper.reply.get());
             app_binder = JNI_CallObjectMethod(env, wrapper.reply, read_strong_binder_method_);
         }
-        if (app_binder) {
-            JNI_NewGlobalRef(env, heart_beat_binder);
-        }
         LOGD("app_binder: {}", static_cast<void*>(app_binder.get()));
         return app_binder;
     }
 
-    std::tuple<int, size_t> Service::RequestLSPDex(JNIEnv *env, const ScopedLocalRef<jobject> &binder) {
+    Service::Bootstrap
+    Service::RequestBootstrap(JNIEnv *env, const ScopedLocalRef<jobject> &binder, bool has_dex,
+                              const std::string &art_build_id) {
+        Bootstrap bootstrap;
         Wrapper wrapper{env, this};
-        bool res = wrapper.transact(binder, DEX_TRANSACTION_CODE);
+        WriteInt(env, wrapper.data.get(), has_dex ? 1 : 0);
+        WriteString(env, wrapper.data.get(),
+                    art_build_id.empty() ? nullptr : JNI_NewStringUTF(env, art_build_id.data()).get());
+        bool res = wrapper.transact(binder, BOOTSTRAP_TRANSACTION_CODE);
         if (!res) {
-            LOGE("Service::RequestLSPDex: transaction failed?");
-            return {-1, 0};
-        }
-        auto parcel_fd = JNI_CallObjectMethod(env, wrapper.reply, read_file_descriptor_method_);
-        int fd = JNI_CallIntMethod(env, parcel_fd, detach_fd_method_);
-        auto size = static_cast<size_t>(JNI_CallLongMethod(env, wrapper.reply, read_long_method_));
-        LOGD("fd={}, size={}", fd, size);
-        return {fd, size};
-    }
-
-    std::map<std::string, std::string>
-    Service::RequestObfuscationMap(JNIEnv *env, const ScopedLocalRef<jobject> &binder) {
-        std::map<std::string, std::string> ret;
-        Wrapper wrapper{env, this};
-        bool res = wrapper.transact(binder, OBFUSCATION_MAP_TRANSACTION_CODE);
-
-        if (!res) {
-            LOGE("Service::RequestObfuscationMap: transaction failed?");
-            return ret;
+            LOGE("Service::RequestBootstrap: transaction failed?");
+            return bootstrap;
         }
-        auto size = JNI_CallIntMethod(env, wrapper.reply, read_int_method_);
-        if (!size || (size & 1) == 1) {
-            LOGW("Service::RequestObfuscationMap: invalid parcel size");
-        }
-
-        auto get_string = [this, &wrapper, &env]() -> std::string {
-            auto s = JNI_Cast<jstring>(JNI_CallObjectMethod(env, wrapper.reply, read_string_method_));
-            return JUTFString(s);
+        auto read_fd = [&]() {
+            return ReadFileDescriptor(env, wrapper.reply.get());
+        };
+        auto read_size = [&]() {
+            return static_cast<size_t>(ReadLong(env, wrapper.reply.get()));
         };
-        for (auto i = 0; i < size / 2; i++) {
-            // DO NOT TOUCH, or value evaluates before key.
-            auto &&key = get_string();
-            ret[key] = get_string();
+        // the dex is left out, size 0, if we have it preloaded already
+        bootstrap.dex_size = read_size();
+        if (bootstrap.dex_size > 0) bootstrap.dex_fd = read_fd();
+        int map_fd = read_fd();
+        auto map_size = read_size();
+        LOGD("dex fd={}, size={}; obfuscation map fd={}, size={}",
+             bootstrap.dex_fd, bootstrap.dex_size, map_fd, map_size);
+
+        bootstrap.obfs_map = ObfuscationMap(map_fd, map_size);
+        if (auto art_symbols = JNI_Cast<jbyteArray>(
+                    JNI_CallObjectMethod(env, wrapper.reply, create_byte_array_method_))) {
+            bootstrap.art_symbols.resize(env->GetArrayLength(art_symbols.get()));
+            env->GetByteArrayRegion(art_symbols.get(), 0,
+                                    static_cast<jsize>(bootstrap.art_symbols.size()),
+                                    reinterpret_cast<jbyte *>(bootstrap.art_symbols.data()));
         }
 #ifndef NDEBUG
-        for (const auto &i: ret) {
-            LOGD("{} => {}", i.first, i.second);
+        for (size_t i = 0; i < kObfuscatedNameCount; ++i) {
+            LOGD("{} => {}", i < kObfuscationKeyCount ? kObfuscationKeys[i] : "(class)",
+                 bootstrap.obfs_map[i]);
         }
 #endif
+        return bootstrap;
+    }
 
-        return ret;
+    void Service::SendStartupRecord(JNIEnv *env, const ScopedLocalRef<jobject> &binder,
+                                    const StartupRecord &record) {
+        Wrapper wrapper{env, this};
+        auto *data = wrapper.data.get();
+        // oneway transactions carry no calling pid
+        WriteInt(env, data, getpid());
+        WriteInt(env, data, static_cast<jint>(record.flags));
+        WriteInt(env, data, static_cast<jint>(record.hooks));
+        WriteInt(env, data, static_cast<jint>(record.total_us));
+        WriteInt(env, data, static_cast<jint>(record.minor_faults));
+        WriteInt(env, data, static_cast<jint>(record.phase_us.size()));
+        for (auto us: record.phase_us) WriteInt(env, data, static_cast<jint>(us));
+        if (!wrapper.transact(binder, STARTUP_RECORD_TRANSACTION_CODE, FLAG_ONEWAY)) {
+            LOGW("failed to send startup record");
+        }
+    }
+
+    void Service::SendArtSymbols(JNIEnv *env, const ScopedLocalRef<jobject> &binder,
+                                 const std::string &art_build_id, std::string_view art_symbols) {
+        Wrapper wrapper{env, this};
+        auto *data = wrapper.data.get();
+        ScopedLocalRef<jbyteArray> blob(env, env->NewByteArray(static_cast<jsize>(art_symbols.size())));
+        if (!blob) return;
+        env->SetByteArrayRegion(blob.get(), 0, static_cast<jsize>(art_symbols.size()),
+                                reinterpret_cast<const jbyte *>(art_symbols.data()));
+        WriteInt(env, data, getpid());
+        WriteString(env, data, JNI_NewStringUTF(env, art_build_id.data()).get());
+        JNI_CallVoidMethod(env, wrapper.data, write_byte_array_method_, blob);
+        if (!wrapper.transact(binder, ART_SYMBOLS_TRANSACTION_CODE, FLAG_ONEWAY)) {
+            LOGW("failed to send art symbols");
+        }
     }
 }  // namespace lspd
@@ -24,22 +24,36 @@
 #ifndef LSPOSED_SERVICE_H
 #define LSPOSED_SERVICE_H
 
+#include <atomic>
 #include <map>
+#include <string>
+#include <vector>
 #include <jni.h>
+#include "config_bridge.h"
 #include "context.h"
+#include "startup_profiler.h"
 
 using namespace std::literals::string_view_literals;
 
 namespace lspd {
     class Service {
-        constexpr static jint DEX_TRANSACTION_CODE = 1310096052;
-        constexpr static jint OBFUSCATION_MAP_TRANSACTION_CODE = 724533732;
+        constexpr static jint BOOTSTRAP_TRANSACTION_CODE = 1281652293;
         constexpr static jint BRIDGE_TRANSACTION_CODE = 1598837584;
+        constexpr static jint STARTUP_RECORD_TRANSACTION_CODE =
+                ('_' << 24) | ('L' << 16) | ('S' << 8) | 'R';
+        constexpr static jint ART_SYMBOLS_TRANSACTION_CODE =
+                ('_' << 24) | ('L' << 16) | ('S' << 8) | 'A';
+        constexpr static jint FLAG_ONEWAY = 1;
         constexpr static auto BRIDGE_SERVICE_DESCRIPTOR = "LSPosed"sv;
+        constexpr static auto BRIDGE_SERVICE_DESCRIPTOR16 = u"LSPosed"sv;
         constexpr static auto BRIDGE_SERVICE_NAME = "activity"sv;
         constexpr static auto SYSTEM_SERVER_BRIDGE_SERVICE_NAME = "serial"sv;
         constexpr static jint BRIDGE_ACTION_GET_BINDER = 2;
-        inline static jint SET_ACTIVITY_CONTROLLER_CODE = -1;
+        constexpr static jint SHELL_COMMAND_TRANSACTION_CODE =
+                ('_' << 24) | ('C' << 16) | ('M' << 8) | 'D';
+        // android::status_t
+        constexpr static int32_t STATUS_OK = 0;
+        constexpr static int32_t STATUS_UNKNOWN_TRANSACTION = INT32_MIN + 6;
 
         class Wrapper {
         public:
@@ -55,9 +69,10 @@ namespace lspd {
             reply(lsplant::JNI_CallStaticObjectMethod(env, service->parcel_class_, service->obtain_method_))
             {}
 
-            inline bool transact(const lsplant::ScopedLocalRef<jobject> &binder, jint transaction_code) {
+            inline bool transact(const lsplant::ScopedLocalRef<jobject> &binder, jint transaction_code,
+                                 jint flags = 0) {
                 return JNI_CallBooleanMethod(env_, binder, service_->transact_method_,transaction_code,
-                                      data, reply, 0);
+                                      data, reply, flags);
             }
 
             inline ~Wrapper() {
@@ -67,6 +82,27 @@ namespace lspd {
         };
 
     public:
+        // What happens to the original transaction once its handler returned
+        enum class TransactionDisposition {
+            kConsume,           // the handler's result is the result of the transaction
+            kConsumeIfHandled,  // as kConsume if the handler returned true, else run the original
+            kPassThrough,       // always run the original afterwards
+        };
+
+        // Runs on the binder thread without going through Java
+        using NativeTransactionHandler = jboolean (*)(JNIEnv *env, jobject binder, jint code,
+                                                      jlong data_obj, jlong reply_obj,
+                                                      jint flags);
+
+        // Handlers must be registered before HookBridge installs the hook, since the table is
+        // read by binder threads without locking afterwards. Java handlers are static methods
+        // of the bridge service with the signature (Landroid/os/IBinder;IJJI)Z.
+        void RegisterTransactionHandler(jint code, NativeTransactionHandler handler,
+                                        TransactionDisposition disposition);
+
+        void RegisterTransactionHandler(jint code, jmethodID bridge_method,
+                                        TransactionDisposition disposition);
+
         inline static Service* instance() {
             return instance_.get();
         }
@@ -78,15 +114,36 @@ namespace lspd {
         void InitService(JNIEnv *env);
 
         void HookBridge(const Context& context, JNIEnv *env);
+
+        // The daemon watches the death of this binder to tell that the process is gone, so it is
+        // kept until the process exits unless the process turns out not to be injected
+        void ReleaseHeartBeat(JNIEnv *env);
+
         lsplant::ScopedLocalRef<jobject> RequestBinder(JNIEnv *env, jstring nice_name);
 
         lsplant::ScopedLocalRef<jobject> RequestSystemServerBinder(JNIEnv *env);
 
         lsplant::ScopedLocalRef<jobject> RequestApplicationBinderFromSystemServer(JNIEnv *env, const lsplant::ScopedLocalRef<jobject> &system_server_binder);
 
-        std::tuple<int, size_t> RequestLSPDex(JNIEnv *env, const lsplant::ScopedLocalRef<jobject> &binder);
+        struct Bootstrap {
+            int dex_fd = -1;
+            size_t dex_size = 0;
+            obfuscation_map_t obfs_map;
+            // ArtSymbolCache of art_build_id, empty if the daemon has none
+            std::string art_symbols;
+        };
+
+        // has_dex tells the daemon that the framework dex as shipped is already mapped
+        Bootstrap RequestBootstrap(JNIEnv *env, const lsplant::ScopedLocalRef<jobject> &binder,
+                                   bool has_dex, const std::string &art_build_id);
+
+        // Oneway, the daemon only takes the cache from system_server
+        void SendArtSymbols(JNIEnv *env, const lsplant::ScopedLocalRef<jobject> &binder,
+                            const std::string &art_build_id, std::string_view art_symbols);
 
-        std::map<std::string, std::string> RequestObfuscationMap(JNIEnv *env, const lsplant::ScopedLocalRef<jobject> &binder);
+        // Oneway, the daemon keeps the records and attributes them to the registered process
+        void SendStartupRecord(JNIEnv *env, const lsplant::ScopedLocalRef<jobject> &binder,
+                               const StartupRecord &record);
 
     private:
         static std::unique_ptr<Service> instance_;
@@ -97,7 +154,38 @@ namespace lspd {
         static jboolean
         call_boolean_method_va_replace(JNIEnv *env, jobject obj, jmethodID methodId, va_list args);
 
-        static jboolean exec_transact_replace(jboolean *res, JNIEnv *env, jobject obj, va_list args);
+        struct TransactionHandler {
+            jint code;
+            NativeTransactionHandler native;
+            jmethodID java;
+            TransactionDisposition disposition;
+        };
+
+        void AddTransactionHandler(TransactionHandler handler);
+
+        const TransactionHandler *FindTransactionHandler(jint code) const;
+
+        static jboolean exec_transact_replace(const TransactionHandler &handler, jboolean *res,
+                                              JNIEnv *env, jobject obj, jint code,
+                                              jlong data_obj, jlong reply_obj, jint flags);
+
+        static int32_t java_bbinder_on_transact_replace(void *thiz, uint32_t code,
+                                                        const void *data, void *reply,
+                                                        uint32_t flags);
+
+        bool HookJavaBBinder(JNIEnv *env);
+
+        bool ResolveJavaBinderObjectOffset(JNIEnv *env);
+
+        jobject GetJavaBinderObject(const void *java_bbinder) const {
+            return static_cast<jobject const *>(java_bbinder)[java_binder_object_offset_];
+        }
+
+        JavaVM *java_vm_ = nullptr;
+        // of JavaBBinder::mObject in words, resolved before hooking
+        size_t java_binder_object_offset_ = 0;
+        int32_t (*java_bbinder_on_transact_backup_)(void *thiz, uint32_t code, const void *data,
+                                                    void *reply, uint32_t flags) = nullptr;
 
         JNINativeInterface native_interface_replace_{};
         jmethodID exec_transact_backup_methodID_ = nullptr;
@@ -106,12 +194,16 @@ namespace lspd {
                                                   va_list args) = nullptr;
 
         jclass bridge_service_class_ = nullptr;
-        jmethodID exec_transact_replace_methodID_ = nullptr;
-        jmethodID replace_activity_controller_methodID_ = nullptr;
-        jmethodID replace_shell_command_methodID_ = nullptr;
+        // sorted by code
+        std::vector<TransactionHandler> transaction_handlers_;
+        bool transact_hooked_ = false;
 
         jclass binder_class_ = nullptr;
         jmethodID binder_ctor_ = nullptr;
+        // one per process, shared by every bridge request
+        jobject heart_beat_binder_ = nullptr;
+
+        jobject GetHeartBeatBinder(JNIEnv *env);
 
         jclass service_manager_class_ = nullptr;
         jmethodID get_service_method_ = nullptr;
@@ -129,9 +221,42 @@ namespace lspd {
         jmethodID read_strong_binder_method_ = nullptr;
         jmethodID write_strong_binder_method_ = nullptr;
         jmethodID read_file_descriptor_method_ = nullptr;
-        jmethodID read_int_method_ = nullptr;
         jmethodID read_long_method_ = nullptr;
-        jmethodID read_string_method_ = nullptr;
+        jmethodID write_byte_array_method_ = nullptr;
+        jmethodID create_byte_array_method_ = nullptr;
+
+        // android::Parcel methods of libbinder, called on the native parcel behind a Java
+        // Parcel so that primitives are marshalled without a round trip through Java.
+        // Every entry falls back to the Java method when its symbol is not found.
+        struct ParcelNatives {
+            jfieldID native_ptr = nullptr;
+            int32_t (*write_interface_token)(void *parcel, const char16_t *str, size_t len) = nullptr;
+            int32_t (*write_int32)(void *parcel, int32_t val) = nullptr;
+            int32_t (*write_string16)(void *parcel, const char16_t *str, size_t len) = nullptr;
+            int32_t (*read_int32)(const void *parcel) = nullptr;
+            int64_t (*read_int64)(const void *parcel) = nullptr;
+            int (*read_file_descriptor)(const void *parcel) = nullptr;
+            const uint8_t *(*data)(const void *parcel) = nullptr;
+        } parcel_natives_;
+
+        void InitParcelNatives(JNIEnv *env);
+
+        void *GetNativeParcel(JNIEnv *env, jobject parcel) const;
+
+        void WriteInterfaceToken(JNIEnv *env, jobject parcel);
+
+        void WriteInt(JNIEnv *env, jobject parcel, jint val);
+
+        void WriteString(JNIEnv *env, jobject parcel, jstring val);
+
+        void ReadException(JNIEnv *env, jobject reply);
+
+        jlong ReadLong(JNIEnv *env, jobject reply);
+
+        // Returns a duplicated fd owned by the caller, or -1
+        int ReadFileDescriptor(JNIEnv *env, jobject reply);
+
+        jmethodID set_data_position_method_ = nullptr;
 
         jclass parcel_file_descriptor_class_ = nullptr;
         jmethodID detach_fd_method_ = nullptr;
@@ -0,0 +1,49 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2022 LSPosed Contributors
+ */
+
+#include <algorithm>
+
+#include "startup_profiler.h"
+
+namespace lspd {
+    namespace {
+        // the daemon reads the values as java ints
+        uint32_t Clamp(uint64_t value) {
+            return static_cast<uint32_t>(std::min<uint64_t>(value, INT32_MAX));
+        }
+
+        uint32_t ToMicros(uint64_t ns) {
+            return Clamp(ns / 1000);
+        }
+    }
+
+    StartupRecord StartupProfiler::Finish(uint32_t flags, uint32_t hooks) const {
+        StartupRecord record{
+                .flags = flags,
+                .hooks = Clamp(hooks),
+                .total_us = ToMicros(last_ - start_),
+                .minor_faults = Clamp(MinorFaults() - start_faults_),
+                .phase_us = {},
+        };
+        for (size_t i = 0; i < kStartupPhaseCount; ++i) {
+            record.phase_us[i] = ToMicros(phase_ns_[i]);
+        }
+        return record;
+    }
+}
@@ -0,0 +1,89 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2022 LSPosed Contributors
+ */
+
+#pragma once
+
+#include <sys/resource.h>
+#include <array>
+#include <cstdint>
+#include <ctime>
+
+namespace lspd {
+    // Phases of the injection path, in the order they run
+    enum StartupPhase : size_t {
+        kPhaseBinder,
+        kPhaseBootstrap,
+        kPhaseLoadDex,
+        kPhaseInitArtHooker,
+        kPhaseInitHooks,
+        kPhaseSetupEntryClass,
+        kPhaseForkCommon,
+        kStartupPhaseCount,
+    };
+
+    // Sent to the daemon once the injection is done, see Service::SendStartupRecord
+    struct StartupRecord {
+        uint32_t flags;
+        uint32_t hooks;
+        uint32_t total_us;
+        // minor page faults taken by the whole injection
+        uint32_t minor_faults;
+        std::array<uint32_t, kStartupPhaseCount> phase_us;
+    };
+
+    // Measures the injection phases of one process with the monotonic clock. The daemon
+    // collects the records in StartupProfiles.java.
+    class StartupProfiler {
+    public:
+        constexpr static uint32_t kFlagSystemServer = 1u << 0;
+        // How this process got the framework dex, neither for a plain mapping of its own
+        constexpr static uint32_t kFlagDexWillNeed = 1u << 1;
+        constexpr static uint32_t kFlagDexFromZygote = 1u << 2;
+
+        StartupProfiler() : start_(Now()), last_(start_), start_faults_(MinorFaults()) {}
+
+        // Accounts the time elapsed since the previous mark to phase
+        inline void Mark(StartupPhase phase) {
+            auto now = Now();
+            phase_ns_[phase] += now - last_;
+            last_ = now;
+        }
+
+        // hooks: inline and ART method hooks installed by the end of startup
+        StartupRecord Finish(uint32_t flags, uint32_t hooks) const;
+
+    private:
+        static uint64_t Now() {
+            timespec ts{};
+            clock_gettime(CLOCK_BOOTTIME, &ts);
+            return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+        }
+
+        static uint64_t MinorFaults() {
+            rusage usage{};
+            getrusage(RUSAGE_SELF, &usage);
+            return usage.ru_minflt;
+        }
+
+        uint64_t start_;
+        uint64_t last_;
+        uint64_t start_faults_;
+        std::array<uint64_t, kStartupPhaseCount> phase_ns_{};
+    };
+}